@@ -1,6 +1,9 @@
 #pragma once
 #include <vector>
 #include <chrono>
+#include <optional>
+#include <set>
+#include <tuple>
 #include "auxiliary/peer_id.hpp"
 #include "torrent/bitfield/bitfield.hpp"
 #include <boost/asio.hpp>
@@ -24,6 +27,9 @@ struct FilePiece
   PieceStatus status;
   std::vector<uint8_t> data;
   uint32_t bytes_downloaded;
+
+  // Written to storage as it downloaded, `data` doesn't hold it
+  bool stored = false;
 };
 
 class InternalContext
@@ -66,6 +72,7 @@ public:
 struct PeerStatus
 {
   bool self_choked = true;
+  bool self_interested = false;
 
   bool remote_choked;
   bool remote_interested;
@@ -75,6 +82,15 @@ struct PeerStatus
   std::chrono::steady_clock::time_point last_message_timestamp;
 
   bool connection_down;
+
+  // BEP 6, negotiated in the handshake
+  bool fast_extension = false;
+  std::set<uint32_t> allowed_fast_pieces;
+  std::set<uint32_t> suggested_pieces;
+
+  // BEP 10, the ids are the remote's, used to address messages to it
+  bool extension_protocol = false;
+  std::optional<uint8_t> remote_ut_pex_id;
 };
 
 struct PeerContactInfo
@@ -87,7 +103,11 @@ struct PeerContactInfo
     return address == o.address && port == o.port;
   }
 
-  bool operator<(const PeerContactInfo& o) const { return address < o.address; }
+  // Consistent with ==, peers sharing an address are told apart by port
+  bool operator<(const PeerContactInfo& o) const
+  {
+    return std::tie(address, port) < std::tie(o.address, o.port);
+  }
 };
 
 struct ExternalPeerContext
@@ -0,0 +1,134 @@
+#include <algorithm>
+
+#include "client/downloader/block_map.hpp"
+
+namespace btr
+{
+BlockMap::BlockMap(uint32_t piece_length, uint32_t block_bytes)
+{
+  reset(piece_length, block_bytes);
+}
+
+void BlockMap::reset(uint32_t piece_length, uint32_t block_bytes)
+{
+  m_piece_length = piece_length;
+  m_block_bytes = block_bytes;
+
+  auto count = (size_t {piece_length} + block_bytes - 1) / block_bytes;
+  m_states.assign(count, BlockState::Missing);
+  m_requested_at.assign(count, clock::time_point {});
+
+  m_received = 0;
+  m_first_missing = 0;
+}
+
+size_t BlockMap::block_count() const
+{
+  return m_states.size();
+}
+
+uint32_t BlockMap::block_offset(size_t block) const
+{
+  return static_cast<uint32_t>(block * m_block_bytes);
+}
+
+uint32_t BlockMap::block_length(size_t block) const
+{
+  return std::min(m_block_bytes, m_piece_length - block_offset(block));
+}
+
+std::optional<size_t> BlockMap::find_block(uint32_t offset,
+                                           uint32_t length) const
+{
+  size_t block = offset / m_block_bytes;
+
+  if (offset % m_block_bytes != 0 || block >= m_states.size()
+      || length != block_length(block))
+  {
+    return std::nullopt;
+  }
+
+  return block;
+}
+
+BlockState BlockMap::state(size_t block) const
+{
+  return m_states[block];
+}
+
+std::optional<size_t> BlockMap::next_missing() const
+{
+  auto missing = std::find(m_states.begin()
+                               + static_cast<std::ptrdiff_t>(m_first_missing),
+                           m_states.end(),
+                           BlockState::Missing);
+
+  if (missing == m_states.end()) {
+    return std::nullopt;
+  }
+
+  return static_cast<size_t>(missing - m_states.begin());
+}
+
+BlockMap::clock::time_point BlockMap::requested_at(size_t block) const
+{
+  return m_requested_at[block];
+}
+
+void BlockMap::mark_requested(size_t block, clock::time_point now)
+{
+  if (m_states[block] != BlockState::Missing) {
+    return;
+  }
+
+  m_states[block] = BlockState::Requested;
+  m_requested_at[block] = now;
+
+  if (block == m_first_missing) {
+    m_first_missing++;
+  }
+}
+
+std::optional<BlockMap::clock::time_point> BlockMap::mark_received(
+    size_t block)
+{
+  auto previous = m_states[block];
+
+  if (previous == BlockState::Received) {
+    return std::nullopt;
+  }
+
+  m_states[block] = BlockState::Received;
+  m_received++;
+
+  if (block == m_first_missing) {
+    m_first_missing++;
+  }
+
+  if (previous != BlockState::Requested) {
+    return std::nullopt;
+  }
+
+  return m_requested_at[block];
+}
+
+void BlockMap::mark_missing(size_t block)
+{
+  if (m_states[block] != BlockState::Requested) {
+    return;
+  }
+
+  m_states[block] = BlockState::Missing;
+  m_first_missing = std::min(m_first_missing, block);
+}
+
+bool BlockMap::is_complete() const
+{
+  return m_received == m_states.size();
+}
+
+size_t BlockMap::blocks_received() const
+{
+  return m_received;
+}
+}  // namespace btr
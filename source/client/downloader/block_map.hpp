@@ -0,0 +1,77 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace btr
+{
+enum class BlockState : uint8_t
+{
+  Missing,
+  Requested,
+  Received
+};
+
+/*
+ * Per-block progress of one piece. Blocks are addressed by their index, the
+ * block at a given offset is found by a division, so tracking a request and
+ * its delivery doesn't allocate. A block only counts once, which makes
+ * completion exact even when a peer delivers a block twice.
+ */
+class BlockMap
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+private:
+  uint32_t m_piece_length = 0;
+  uint32_t m_block_bytes = 1;
+
+  std::vector<BlockState> m_states;
+  std::vector<clock::time_point> m_requested_at;
+
+  size_t m_received = 0;
+
+  // No block before it is Missing
+  size_t m_first_missing = 0;
+
+public:
+  BlockMap() = default;
+
+  BlockMap(uint32_t piece_length, uint32_t block_bytes);
+
+  // Marks every block Missing, keeping the storage
+  void reset(uint32_t piece_length, uint32_t block_bytes);
+
+  size_t block_count() const;
+
+  uint32_t block_offset(size_t block) const;
+
+  uint32_t block_length(size_t block) const;
+
+  // The block exactly spanning offset and length, if there is one
+  std::optional<size_t> find_block(uint32_t offset, uint32_t length) const;
+
+  BlockState state(size_t block) const;
+
+  std::optional<size_t> next_missing() const;
+
+  // When an outstanding block was requested
+  clock::time_point requested_at(size_t block) const;
+
+  void mark_requested(size_t block, clock::time_point now);
+
+  // When the block was requested, empty unless it was outstanding
+  std::optional<clock::time_point> mark_received(size_t block);
+
+  // An outstanding request is dropped, the block may be requested again
+  void mark_missing(size_t block);
+
+  bool is_complete() const;
+
+  size_t blocks_received() const;
+};
+}  // namespace btr
@@ -1,24 +1,49 @@
+#include <algorithm>
 #include <variant>
 
 #include "downloader.hpp"
 
-#include <openssl/sha.h>
-
 #include "auxiliary/variant_aux.hpp"
 
 namespace btr
 {
 Downloader::Downloader(std::shared_ptr<const InternalContext> context,
                        std::shared_ptr<Peer> peer,
+                       std::shared_ptr<HashService> hash_service,
+                       std::shared_ptr<PartialPieces> partial_pieces,
+                       std::shared_ptr<completion_channel> completions,
+                       std::shared_ptr<IStorage> storage,
                        DownloaderPolicy policy)
     : m_application_context {std::move(context)}
     , m_peer {std::move(peer)}
-    , m_policy {policy}
+    , m_hash_service {std::move(hash_service)}
+    , m_partial_pieces {std::move(partial_pieces)}
+    , m_completions {std::move(completions)}
+    , m_storage {std::move(storage)}
+    , m_pipeline {policy.initial_outgoing_requests,
+                  policy.min_outgoing_requests,
+                  policy.max_outgoing_requests,
+                  m_partial_pieces->block_bytes(),
+                  policy.snubbed_outgoing_requests}
     , m_callback {std::make_shared<message_callback>(
-          [this](TorrentMessage m) -> boost::asio::awaitable<void>
+          [this](const TorrentMessage& m) -> boost::asio::awaitable<void>
           { co_await triggered_on_received_message(m); })}
+    , m_block_destination {std::make_shared<block_destination_provider>(
+          [this](const PieceMetadata& header)
+          { return block_destination(header); })}
 {
   m_peer->add_callback({m_callback});
+  m_peer->set_block_destination({m_block_destination});
+}
+
+Downloader::~Downloader()
+{
+  for (auto& [_, share] : m_pieces) {
+    drop_requests(share);
+  }
+
+  // A block read in place that never finished may be written by others
+  release_block_in_transit();
 }
 
 const ExternalPeerContext& Downloader::get_context() const
@@ -31,34 +56,41 @@ const PeerActivity& Downloader::get_activity() const
   return m_peer->get_activity();
 }
 
-boost::asio::awaitable<bool> Downloader::download_piece(uint32_t index)
+const RequestPipeline& Downloader::get_pipeline() const
+{
+  return m_pipeline;
+}
+
+bool Downloader::is_snubbed() const
+{
+  return m_pipeline.is_snubbed();
+}
+
+void Downloader::exchange_peers(std::span<const PeerContactInfo> swarm) const
+{
+  m_peer->exchange_peers(swarm);
+}
+
+boost::asio::awaitable<bool> Downloader::download_piece(uint32_t index,
+                                                      bool duplicate)
 {
   if (!m_peer->get_context().status.remote_bitfield.get(index)) {
     co_return false;
   }
 
-  m_pieces[index] = FilePiece {
-      .index = index,
-      .status = PieceStatus::Pending,
-      .data =
-          std::vector<uint8_t>(m_application_context->get_piece_size(index)),
-      .bytes_downloaded = 0};
+  auto shared = m_partial_pieces->join(index);
+  auto& share = m_pieces[index];
 
-  if (m_peer->get_context().status.self_choked) {
-    co_await m_peer->send_async(TorrentMessage {Interested {}});
+  // The piece was started over, e.g. after it turned out corrupt
+  if (share.shared != shared) {
+    drop_requests(share);
+    share.shared = std::move(shared);
   }
 
-  auto piece_length = m_application_context->get_piece_size(index);
-
-  for (uint32_t offset = 0; offset < piece_length;
-       offset += m_policy.max_block_bytes)
-  {
-    auto req = Request {};
-    req.piece_index = index;
-    req.offset_within_piece = offset;
-    req.length = std::min(piece_length - offset, m_policy.max_block_bytes);
+  share.duplicate = duplicate;
 
-    m_pending_requests.emplace_back(req);
+  if (!m_peer->get_context().status.self_interested) {
+    co_await m_peer->send_async(TorrentMessage {Interested {}});
   }
 
   co_await send_buffered_messages();
@@ -66,69 +98,351 @@ boost::asio::awaitable<bool> Downloader::download_piece(uint32_t index)
   co_return true;
 }
 
-void Downloader::handle_piece(const Piece& piece)
+void Downloader::cancel_piece(uint32_t index)
 {
-  if (!m_pieces.contains(piece.get_metadata().piece_index)) {
+  auto entry = m_pieces.find(index);
+
+  if (entry == m_pieces.end()) {
     return;
   }
 
+  auto& share = entry->second;
+  const auto& blocks = share.shared->blocks;
+
+  for (const auto& [block, _] : share.requests) {
+    m_peer->try_send(TorrentMessage {Cancel {
+        index, blocks.block_offset(block), blocks.block_length(block)}});
+  }
+
+  drop_requests(share);
+  m_pieces.erase(entry);
+}
+
+void Downloader::cancel_block(uint32_t index, size_t block)
+{
+  auto entry = m_pieces.find(index);
+
+  if (entry == m_pieces.end() || !take_request(entry->second, block)) {
+    return;
+  }
+
+  const auto& blocks = entry->second.shared->blocks;
+
+  // Should the queue be full, the block still arrives and is ignored
+  m_peer->try_send(TorrentMessage {Cancel {
+      index, blocks.block_offset(block), blocks.block_length(block)}});
+}
+
+boost::asio::awaitable<void> Downloader::expire_requests()
+{
+  auto now = BlockMap::clock::now();
+  auto timeout = m_pipeline.request_timeout();
+  std::vector<Cancel> expired;
+  bool stalled_in_transit = false;
+
+  for (auto& [index, share] : m_pieces) {
+    const auto& blocks = share.shared->blocks;
+
+    for (auto request = share.requests.begin();
+         request != share.requests.end();)
+    {
+      auto [block, requested_at] = *request;
+
+      if (now - requested_at <= timeout) {
+        request++;
+        continue;
+      }
+
+      // Free for another peer to fetch
+      share.shared->drop_request(block, *this);
+      request = share.requests.erase(request);
+      m_outstanding_requests--;
+
+      if (share.shared == m_piece_in_transit && block == m_block_in_transit) {
+        stalled_in_transit = true;
+      }
+
+      expired.emplace_back(static_cast<uint32_t>(index),
+                           blocks.block_offset(block),
+                           blocks.block_length(block));
+    }
+  }
+
+  if (expired.empty()) {
+    co_return;
+  }
+
+  m_pipeline.on_timed_out();
+
+  // The peer stalled in the middle of a block it's reading in place. Its
+  // bytes could still land once others wrote the block, so it's dropped.
+  if (stalled_in_transit) {
+    release_block_in_transit();
+    disconnect();
+    co_return;
+  }
+
+  // A block that still arrives is taken, cancelling only spares the upload
+  for (const auto& cancel : expired) {
+    if (!m_peer->try_send(TorrentMessage {cancel})) {
+      co_await m_peer->send_async(TorrentMessage {cancel});
+    }
+  }
+
+  co_await send_buffered_messages();
+}
+
+std::optional<size_t> Downloader::missing_blocks(uint32_t index) const
+{
+  auto entry = m_pieces.find(index);
+
+  if (entry == m_pieces.end()) {
+    return std::nullopt;
+  }
+
+  const auto& blocks = entry->second.shared->blocks;
+
+  return blocks.block_count() - blocks.blocks_received();
+}
+
+bool Downloader::store_block(SharedPiece& shared,
+                             uint32_t offset,
+                             std::span<const uint8_t> data)
+{
+  auto& piece = shared.piece;
+  auto& blocks = shared.blocks;
+  auto block = blocks.find_block(offset, static_cast<uint32_t>(data.size()));
+
+  // Duplicates must neither overwrite nor count twice. The peers still
+  // fetching the block are told to stop.
+  if (!block || !shared.receive(*block, *this)) {
+    return false;
+  }
+
+  // Blocks read in place already sit at their destination, streamed ones
+  // were written to storage
+  bool in_place = data.data() == piece.data.data() + offset;
+
+  if (!shared.streaming && !in_place) {
+    std::ranges::copy(data, piece.data.data() + offset);
+  }
+
+  piece.bytes_downloaded += static_cast<uint32_t>(data.size());
+  piece.status = PieceStatus::Active;
+
+  return true;
+}
+
+boost::asio::awaitable<bool> Downloader::receive_block(
+    const std::shared_ptr<SharedPiece>& shared,
+    uint32_t offset,
+    std::span<const uint8_t> data)
+{
+  if (shared->streaming) {
+    auto& blocks = shared->blocks;
+    auto block = blocks.find_block(offset, static_cast<uint32_t>(data.size()));
+
+    if (!block || blocks.state(*block) == BlockState::Received) {
+      co_return false;
+    }
+
+    // Only counted once written, so hashing never reads it back too early
+    co_await m_storage->push_block(m_application_context->info_hash_as_string(),
+                                   shared->piece.index,
+                                   shared->storage_part,
+                                   offset,
+                                   data);
+  }
+
+  co_return store_block(*shared, offset, data);
+}
+
+boost::asio::awaitable<void> Downloader::hash_received_prefix(
+    std::shared_ptr<SharedPiece> shared)
+{
+  auto& download = *shared;
+
+  // Whoever is hashing picks up the blocks received meanwhile
+  if (download.hashing || download.piece.status == PieceStatus::Complete) {
+    co_return;
+  }
+
+  auto& blocks = download.blocks;
+  auto data = std::span {download.piece.data};
+
+  download.hashing = true;
+
+  while (true) {
+    auto first = download.hashed_blocks;
+    auto last = first;
+
+    while (last < blocks.block_count()
+           && blocks.state(last) == BlockState::Received)
+    {
+      last++;
+    }
+
+    if (last == first) {
+      break;
+    }
+
+    if (download.streaming) {
+      last = std::min(last, first + download.window_blocks);
+    }
+
+    auto begin = blocks.block_offset(first);
+    auto end = blocks.block_offset(last - 1) + blocks.block_length(last - 1);
+
+    // Streamed blocks are read back into the piece's window
+    auto received = download.streaming ? data.first(end - begin)
+                                       : data.subspan(begin, end - begin);
+
+    if (download.streaming
+        && !co_await m_storage->pull_block(
+            m_application_context->info_hash_as_string(),
+            download.piece.index,
+            download.storage_part,
+            begin,
+            received))
+    {
+      break;
+    }
+
+    co_await m_hash_service->update(download.hasher, received);
+
+    download.hashed_blocks = last;
+  }
+
+  download.hashing = false;
+
+  if (download.hashed_blocks == blocks.block_count()) {
+    auto index = static_cast<uint32_t>(download.piece.index);
+    download.piece.status = PieceStatus::Complete;
+
+    if (!m_completions->try_send(boost::system::error_code {}, index)) {
+      co_await m_completions->async_send(
+          boost::system::error_code {}, index, boost::asio::use_awaitable);
+    }
+  }
+}
+
+boost::asio::awaitable<void> Downloader::handle_piece(const Piece& piece)
+{
+  const auto& metadata = piece.get_metadata();
+
+  // Whatever the in-place read delivered, the block is open to others again
+  release_block_in_transit();
+
+  // Late blocks still count, as long as the piece is being downloaded
+  auto shared = m_partial_pieces->find(metadata.piece_index);
+
+  if (!shared) {
+    co_return;
+  }
+
   auto data = piece.get_payload();
-  m_active_requests.erase(
-      RequestIdentifier {piece.get_metadata().piece_index,
-                         piece.get_metadata().offset_within_piece,
-                         static_cast<uint32_t>(data.size())});
+  auto delivered_at = RequestPipeline::clock::now();
+
+  m_pipeline.on_block_received();
+
+  co_await receive_block(shared, metadata.offset_within_piece, data);
+
+  auto entry = m_pieces.find(metadata.piece_index);
+  auto block = shared->blocks.find_block(metadata.offset_within_piece,
+                                         static_cast<uint32_t>(data.size()));
+
+  if (entry != m_pieces.end() && entry->second.shared == shared && block) {
+    if (auto requested_at = take_request(entry->second, *block)) {
+      m_pipeline.on_block_delivered(data.size(), *requested_at, delivered_at);
+    }
+  }
 
-  FilePiece& current_piece = m_pieces[piece.get_metadata().piece_index];
+  co_await hash_received_prefix(std::move(shared));
+}
+
+std::span<uint8_t> Downloader::block_destination(const PieceMetadata& header)
+{
+  auto entry = m_pieces.find(header.piece_index);
+
+  // Streamed blocks go from the receive buffer straight to storage
+  if (entry == m_pieces.end() || entry->second.shared->streaming) {
+    return {};
+  }
+
+  auto& share = entry->second;
+  auto& shared = *share.shared;
+  auto block = shared.blocks.find_block(header.offset_within_piece,
+                                        header.block_length());
+
+  if (!block || !share.requests.contains(*block)
+      || !shared.start_transit(*block, *this))
+  {
+    return {};
+  }
 
-  std::ranges::copy(
-      data,
-      current_piece.data.begin() + piece.get_metadata().offset_within_piece);
+  m_piece_in_transit = share.shared;
+  m_block_in_transit = *block;
 
-  current_piece.bytes_downloaded += data.size();
+  return std::span {shared.piece.data}.subspan(header.offset_within_piece,
+                                               header.block_length());
+}
 
-  if (current_piece.bytes_downloaded == current_piece.data.size()) {
-    current_piece.status = PieceStatus::Complete;
-  } else {
-    current_piece.status = PieceStatus::Active;
+void Downloader::release_block_in_transit()
+{
+  if (auto transit = std::exchange(m_piece_in_transit, nullptr)) {
+    transit->end_transit(m_block_in_transit, *this);
   }
 }
 
 boost::asio::awaitable<void> Downloader::triggered_on_received_message(
-    TorrentMessage trigger)
+    const TorrentMessage& trigger)
 {
   bool should_try_sending_messages = false;
   bool should_choke_active_requests = false;
   bool should_handle_piece = false;
+  bool should_handle_reject = false;
 
   std::visit(
       overloaded {
-          [](auto&) {},
-          [&should_try_sending_messages](Unchoke)
+          [](const auto&) {},
+          [&should_try_sending_messages](const Unchoke&)
           { should_try_sending_messages = true; },
-          [&should_try_sending_messages, &should_choke_active_requests](Choke)
+          [&should_try_sending_messages,
+           &should_choke_active_requests](const Choke&)
           {
             should_choke_active_requests = true;
             should_try_sending_messages = true;
           },
-          [&should_try_sending_messages, &should_handle_piece](Piece)
+          [&should_try_sending_messages, &should_handle_piece](const Piece&)
           {
             should_handle_piece = true;
             should_try_sending_messages = true;
-          }},
+          },
+          [&should_try_sending_messages,
+           &should_handle_reject](const RejectRequest&)
+          {
+            should_handle_reject = true;
+            should_try_sending_messages = true;
+          },
+          [&should_try_sending_messages](const AllowedFast&)
+          { should_try_sending_messages = true; }},
       trigger);
 
   if (should_handle_piece) {
-    handle_piece(std::get<Piece>(trigger));
+    co_await handle_piece(std::get<Piece>(trigger));
   }
 
-  if (should_choke_active_requests) {
-    for (auto& identifier : m_active_requests) {
-      m_pending_requests.emplace_front(identifier.piece_index,
-                                       identifier.piece_offset,
-                                       identifier.block_length);
-    }
+  if (should_handle_reject) {
+    handle_reject(std::get<RejectRequest>(trigger));
+  }
 
-    m_active_requests.clear();
+  // With the Fast Extension a choke doesn't drop requests, rejects do
+  if (should_choke_active_requests
+      && !m_peer->get_context().status.fast_extension)
+  {
+    for (auto& [_, share] : m_pieces) {
+      drop_requests(share);
+    }
   }
 
   if (should_try_sending_messages) {
@@ -136,46 +450,99 @@ boost::asio::awaitable<void> Downloader::triggered_on_received_message(
   }
 }
 
-boost::asio::awaitable<void> Downloader::send_buffered_messages()
+void Downloader::handle_reject(const RejectRequest& reject)
 {
-  while (
-      !m_peer->get_context().status.self_choked && !m_pending_requests.empty()
-      && m_active_requests.size() < m_policy.max_concurrent_outgoing_requests)
-  {
-    auto req = m_pending_requests.front();
+  auto entry = m_pieces.find(reject.piece_index);
+
+  if (entry == m_pieces.end()) {
+    return;
+  }
 
-    m_active_requests.emplace(
-        req.piece_index, req.offset_within_piece, req.length);
-    m_pending_requests.pop_front();
+  auto block = entry->second.shared->blocks.find_block(
+      reject.offset_within_piece, reject.length);
 
-    co_await m_peer->send_async(TorrentMessage {req});
+  if (block) {
+    take_request(entry->second, *block);
   }
 }
 
-boost::asio::awaitable<std::optional<FilePiece>> Downloader::retrieve_piece(
-    size_t index)
+std::optional<BlockMap::clock::time_point> Downloader::take_request(
+    PieceShare& share, size_t block)
 {
-  if (!m_pieces.contains(index)) {
-    co_return std::nullopt;
+  auto request = share.requests.find(block);
+
+  if (request == share.requests.end()) {
+    return std::nullopt;
   }
 
-  if (m_pieces[index].status == PieceStatus::Complete) {
-    auto piece = m_pieces.extract(m_pieces.find(index)).mapped();
+  auto requested_at = request->second;
+
+  share.requests.erase(request);
+  share.shared->drop_request(block, *this);
+  m_outstanding_requests--;
 
-    std::vector<uint8_t> hash(SHA_DIGEST_LENGTH);
+  return requested_at;
+}
 
-    SHA1(piece.data.data(), piece.data.size(), hash.data());
+void Downloader::drop_requests(PieceShare& share)
+{
+  for (const auto& [block, _] : share.requests) {
+    share.shared->drop_request(block, *this);
+  }
 
-    if (hash != m_application_context->piece_hashes[index]) {
-      piece.status = PieceStatus::Corrupt;
+  m_outstanding_requests -= share.requests.size();
+  share.requests.clear();
+}
+
+bool Downloader::can_request(uint32_t index) const
+{
+  const auto& status = m_peer->get_context().status;
+
+  return !status.self_choked
+      || (status.fast_extension && status.allowed_fast_pieces.contains(index));
+}
+
+boost::asio::awaitable<void> Downloader::send_buffered_messages()
+{
+  std::vector<Request> burst;
+  auto now = RequestPipeline::clock::now();
+  auto depth = m_pipeline.depth();
+
+  // Pieces may be cancelled while sending, so the burst is picked up front
+  for (auto& [index, share] : m_pieces) {
+    if (!can_request(static_cast<uint32_t>(index))) {
+      continue;
     }
 
-    co_return piece;
+    auto& blocks = share.shared->blocks;
+
+    while (m_outstanding_requests < depth) {
+      auto block = share.shared->next_block(share.requests, share.duplicate);
+
+      if (!block) {
+        break;
+      }
+
+      if (m_outstanding_requests == 0) {
+        m_pipeline.on_resumed();
+      }
+
+      share.shared->add_request(*block, now, *this);
+      share.requests.emplace(*block, now);
+      m_outstanding_requests++;
+
+      burst.emplace_back(static_cast<uint32_t>(index),
+                         blocks.block_offset(*block),
+                         blocks.block_length(*block));
+    }
   }
 
-  co_return FilePiece {.index = index,
-                       .status = m_pieces[index].status,
-                       .bytes_downloaded = m_pieces[index].bytes_downloaded};
+  // Queue the whole burst at once so the peer flushes it in one write
+  for (const auto& req : burst) {
+    if (!m_peer->try_send(TorrentMessage {req})) {
+      co_await m_peer->send_async(TorrentMessage {req});
+    }
+  }
 }
 
 boost::asio::awaitable<void> Downloader::restart_connection() const
@@ -183,4 +550,9 @@ boost::asio::awaitable<void> Downloader::restart_connection() const
   return m_peer->start_async();
 }
 
+void Downloader::disconnect() const
+{
+  m_peer->stop();
+}
+
 }  // namespace btr
\ No newline at end of file
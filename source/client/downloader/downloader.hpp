@@ -1,62 +1,148 @@
 #pragma once
 
-#include <deque>
 #include <memory>
 #include <optional>
 #include <map>
-#include <set>
 
+#include <boost/asio/experimental/channel.hpp>
+
+#include "client/downloader/block_map.hpp"
+#include "client/downloader/hash_service.hpp"
+#include "client/downloader/pipeline.hpp"
+#include "client/downloader/shared_piece.hpp"
 #include "client/peer.hpp"
+#include "client/storage/storage.hpp"
 
 namespace btr
 {
 
+// Pieces whose every block arrived and was hashed, announced as they finish
+using completion_channel =
+    boost::asio::experimental::channel<void(boost::system::error_code,
+                                            uint32_t)>;
+
 struct DownloaderPolicy
 {
-  uint32_t max_block_bytes = 8 * 1024;
-  uint16_t max_concurrent_outgoing_requests = 7;
+  // Outstanding requests follow the peer's bandwidth-delay product within
+  // these bounds
+  uint16_t initial_outgoing_requests = 7;
+  uint16_t min_outgoing_requests = 2;
+  uint16_t max_outgoing_requests = 512;
+
+  // A peer that let requests time out is only probed until it delivers again
+  uint16_t snubbed_outgoing_requests = 1;
 };
 
-struct RequestIdentifier
+// This peer's part in downloading a shared piece
+struct PieceShare
 {
-  uint32_t piece_index;
-  uint32_t piece_offset;
-  uint32_t block_length;
-  auto operator<=>(const RequestIdentifier&) const = default;
+  std::shared_ptr<SharedPiece> shared;
+
+  // Blocks requested from this peer and not delivered yet
+  block_requests requests;
+
+  // Blocks other peers were asked for are requested as well, in endgame or
+  // when a deadline is at risk
+  bool duplicate = false;
 };
 
-class Downloader
+class Downloader : public IBlockRequester
 {
   std::shared_ptr<const InternalContext> m_application_context;
   std::shared_ptr<Peer> m_peer;
-  DownloaderPolicy m_policy;
+  std::shared_ptr<HashService> m_hash_service;
+  std::shared_ptr<PartialPieces> m_partial_pieces;
+  std::shared_ptr<completion_channel> m_completions;
+  std::shared_ptr<IStorage> m_storage;
+
+  std::map<size_t, PieceShare> m_pieces;
+  size_t m_outstanding_requests = 0;
+
+  // Holds the piece a block is read into in place until the block is handled
+  std::shared_ptr<SharedPiece> m_piece_in_transit;
+  size_t m_block_in_transit = 0;
 
-  std::map<size_t, FilePiece> m_pieces;
-  std::deque<Request> m_pending_requests;
-  std::set<RequestIdentifier> m_active_requests;
+  RequestPipeline m_pipeline;
   std::shared_ptr<message_callback> m_callback;
+  std::shared_ptr<block_destination_provider> m_block_destination;
 
 public:
   Downloader(std::shared_ptr<const InternalContext> context,
              std::shared_ptr<Peer> peer,
+             std::shared_ptr<HashService> hash_service,
+             std::shared_ptr<PartialPieces> partial_pieces,
+             std::shared_ptr<completion_channel> completions,
+             std::shared_ptr<IStorage> storage,
              DownloaderPolicy policy = {});
 
+  // Its requests no longer hold on to the blocks of the shared pieces
+  ~Downloader() override;
+
   const ExternalPeerContext& get_context() const;
 
   const PeerActivity& get_activity() const;
 
-  boost::asio::awaitable<bool> download_piece(uint32_t index);
+  const RequestPipeline& get_pipeline() const;
+
+  bool is_snubbed() const;
+
+  void exchange_peers(std::span<const PeerContactInfo> swarm) const;
+
+  // Joins the piece's shared download, requesting blocks nobody else was
+  // asked for. With `duplicate`, those other peers were asked for as well.
+  boost::asio::awaitable<bool> download_piece(uint32_t index,
+                                              bool duplicate = false);
+
+  // Stops downloading a piece, cancelling its outstanding requests
+  void cancel_piece(uint32_t index);
+
+  // Another peer delivered the block first, its request here is cancelled
+  void cancel_block(uint32_t index, size_t block) override;
 
-  boost::asio::awaitable<std::optional<FilePiece>> retrieve_piece(size_t index);
+  // Cancels requests unanswered past the peer's deadline, snubbing it
+  boost::asio::awaitable<void> expire_requests();
+
+  // Blocks of the piece not received yet, empty if it isn't downloaded
+  std::optional<size_t> missing_blocks(uint32_t index) const;
 
   boost::asio::awaitable<void> restart_connection() const;
 
+  void disconnect() const;
+
 private:
   boost::asio::awaitable<void> triggered_on_received_message(
-      TorrentMessage trigger);
+      const TorrentMessage& trigger);
 
   boost::asio::awaitable<void> send_buffered_messages();
 
-  void handle_piece(const Piece& piece);
+  bool store_block(SharedPiece& shared,
+                   uint32_t offset,
+                   std::span<const uint8_t> data);
+
+  // Stores a block, writing it to storage first if the piece is streamed
+  boost::asio::awaitable<bool> receive_block(
+      const std::shared_ptr<SharedPiece>& shared,
+      uint32_t offset,
+      std::span<const uint8_t> data);
+
+  boost::asio::awaitable<void> hash_received_prefix(
+      std::shared_ptr<SharedPiece> shared);
+
+  boost::asio::awaitable<void> handle_piece(const Piece& piece);
+
+  void handle_reject(const RejectRequest& reject);
+
+  bool can_request(uint32_t index) const;
+
+  // When the block was requested from this peer, if it was
+  std::optional<BlockMap::clock::time_point> take_request(PieceShare& share,
+                                                          size_t block);
+
+  void drop_requests(PieceShare& share);
+
+  std::span<uint8_t> block_destination(const PieceMetadata& header);
+
+  // The block read in place is open to others again
+  void release_block_in_transit();
 };
-}  // namespace btr
\ No newline at end of file
+}  // namespace btr
@@ -0,0 +1,49 @@
+#include "client/downloader/hash_service.hpp"
+
+namespace btr
+{
+HashService::HashService(HashServicePolicy policy)
+    : m_pool {policy.threads}
+    , m_slots {m_pool.get_executor(), policy.max_queued_jobs}
+{
+}
+
+boost::asio::awaitable<void> HashService::update(
+    PieceHasher& hasher, std::span<const uint8_t> data)
+{
+  co_await m_slots.async_send(boost::system::error_code {},
+                              boost::asio::use_awaitable);
+
+  co_await boost::asio::co_spawn(
+      m_pool,
+      [&hasher, data]() -> boost::asio::awaitable<void>
+      {
+        hasher.update(data);
+        co_return;
+      },
+      boost::asio::use_awaitable);
+
+  m_slots.try_receive([](boost::system::error_code) {});
+}
+
+boost::asio::awaitable<std::vector<sha1::Digest>> HashService::hash_many(
+    std::vector<std::span<const uint8_t>> pieces)
+{
+  co_await m_slots.async_send(boost::system::error_code {},
+                              boost::asio::use_awaitable);
+
+  auto digests = co_await boost::asio::co_spawn(
+      m_pool,
+      [&pieces]() -> boost::asio::awaitable<std::vector<sha1::Digest>>
+      {
+        std::vector<sha1::Digest> result(pieces.size());
+        sha1::hash_many(pieces, result);
+        co_return result;
+      },
+      boost::asio::use_awaitable);
+
+  m_slots.try_receive([](boost::system::error_code) {});
+
+  co_return digests;
+}
+}  // namespace btr
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/asio/experimental/channel.hpp>
+
+#include "client/downloader/piece_hasher.hpp"
+#include "torrent/hash/sha1.hpp"
+
+namespace btr
+{
+struct HashServicePolicy
+{
+  size_t threads = std::max(1u, std::thread::hardware_concurrency() / 2);
+
+  // Callers wait for a slot beyond this, which stalls their peer's receiving
+  // and so bounds the data waiting to be hashed
+  size_t max_queued_jobs = 32;
+};
+
+/*
+ * Runs piece hashing on a dedicated thread pool so the network thread keeps
+ * serving sockets. Jobs borrow the caller's buffers, which must stay
+ * untouched until the job completes; completion resumes the caller on its
+ * own executor. Must only be used from a single network thread.
+ */
+class HashService
+{
+  using slots_t =
+      boost::asio::experimental::channel<void(boost::system::error_code)>;
+
+  boost::asio::thread_pool m_pool;
+  slots_t m_slots;
+
+public:
+  HashService(HashServicePolicy policy = {});
+
+  // Appends `data` to `hasher` on the pool
+  boost::asio::awaitable<void> update(PieceHasher& hasher,
+                                      std::span<const uint8_t> data);
+
+  // Hashes whole pieces, side by side when the CPU allows it
+  boost::asio::awaitable<std::vector<sha1::Digest>> hash_many(
+      std::vector<std::span<const uint8_t>> pieces);
+};
+}  // namespace btr
@@ -0,0 +1,47 @@
+#include <stdexcept>
+
+#include "client/downloader/piece_hasher.hpp"
+
+namespace btr
+{
+PieceHasher::PieceHasher()
+    : m_context {EVP_MD_CTX_new()}
+{
+  if (!m_context) {
+    throw std::bad_alloc();
+  }
+
+  reset();
+}
+
+void PieceHasher::reset()
+{
+  if (EVP_DigestInit_ex(m_context.get(), EVP_sha1(), nullptr) != 1) {
+    throw std::runtime_error("Failed initializing SHA-1");
+  }
+
+  m_hashed_bytes = 0;
+}
+
+void PieceHasher::update(std::span<const uint8_t> data)
+{
+  EVP_DigestUpdate(m_context.get(), data.data(), data.size());
+  m_hashed_bytes += data.size();
+}
+
+size_t PieceHasher::hashed_bytes() const
+{
+  return m_hashed_bytes;
+}
+
+std::vector<uint8_t> PieceHasher::finish()
+{
+  std::vector<uint8_t> digest(EVP_MAX_MD_SIZE);
+  unsigned int length = 0;
+
+  EVP_DigestFinal_ex(m_context.get(), digest.data(), &length);
+  digest.resize(length);
+
+  return digest;
+}
+}  // namespace btr
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include <openssl/evp.h>
+
+namespace btr
+{
+/*
+ * SHA-1 of a piece, computed while it downloads. Data is fed in order as the
+ * received prefix of the piece grows, so little is left to hash once the
+ * last block arrives, and each block is hashed while it's still in cache.
+ */
+class PieceHasher
+{
+  struct ContextDeleter
+  {
+    void operator()(EVP_MD_CTX* context) const { EVP_MD_CTX_free(context); }
+  };
+
+  std::unique_ptr<EVP_MD_CTX, ContextDeleter> m_context;
+  size_t m_hashed_bytes = 0;
+
+public:
+  PieceHasher();
+
+  void reset();
+
+  // Appends the next bytes of the piece
+  void update(std::span<const uint8_t> data);
+
+  size_t hashed_bytes() const;
+
+  // Digest of everything fed since the last reset
+  std::vector<uint8_t> finish();
+};
+}  // namespace btr
@@ -0,0 +1,49 @@
+#include "client/downloader/piece_pool.hpp"
+
+namespace btr
+{
+PiecePool::PiecePool(uint32_t piece_size, PiecePoolPolicy policy)
+    : m_piece_size {piece_size}
+    , m_policy {policy}
+{
+}
+
+std::vector<uint8_t> PiecePool::acquire(size_t size)
+{
+  if (m_idle.empty()) {
+    m_idle.emplace_back(m_piece_size);
+    ++m_allocations;
+  }
+
+  auto buffer = std::move(m_idle.back());
+  m_idle.pop_back();
+
+  // Only shrinks, so nothing is zeroed again
+  buffer.resize(size);
+
+  return buffer;
+}
+
+void PiecePool::release(std::vector<uint8_t>&& buffer)
+{
+  // Foreign or moved-from buffers aren't worth keeping
+  if (buffer.capacity() < m_piece_size
+      || pooled_bytes() + m_piece_size > m_policy.max_pooled_bytes)
+  {
+    return;
+  }
+
+  buffer.resize(m_piece_size);
+  m_idle.push_back(std::move(buffer));
+}
+
+size_t PiecePool::pooled_bytes() const
+{
+  return m_idle.size() * m_piece_size;
+}
+
+uint64_t PiecePool::allocations() const
+{
+  return m_allocations;
+}
+}  // namespace btr
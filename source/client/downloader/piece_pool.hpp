@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace btr
+{
+struct PiecePoolPolicy
+{
+  // Idle buffers beyond this are freed instead of kept for reuse
+  size_t max_pooled_bytes = 256 * 1024 * 1024;
+};
+
+/*
+ * Recycles piece buffers. Every buffer is allocated at the torrent's piece
+ * size, so once its pages were touched, reusing it neither allocates nor
+ * faults. A buffer comes back once its piece was handed to storage or
+ * dropped; the short last piece borrows a full sized one as well.
+ */
+class PiecePool
+{
+  uint32_t m_piece_size;
+  PiecePoolPolicy m_policy;
+
+  std::vector<std::vector<uint8_t>> m_idle;
+
+  uint64_t m_allocations = 0;
+
+public:
+  PiecePool(uint32_t piece_size, PiecePoolPolicy policy = {});
+
+  // A buffer of `size` bytes, its contents are unspecified
+  std::vector<uint8_t> acquire(size_t size);
+
+  void release(std::vector<uint8_t>&& buffer);
+
+  size_t pooled_bytes() const;
+
+  uint64_t allocations() const;
+};
+}  // namespace btr
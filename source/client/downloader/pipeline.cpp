@@ -0,0 +1,135 @@
+#include <algorithm>
+#include <cmath>
+
+#include "client/downloader/pipeline.hpp"
+
+namespace btr
+{
+namespace
+{
+// Above one so a queue-limited peer is offered more than it just delivered
+constexpr double PIPELINE_GAIN = 2.0;
+
+// Route changes may raise the RTT for good, so old minimums expire
+constexpr auto MIN_RTT_LIFETIME = std::chrono::seconds(10);
+
+// Keeps low RTT peers from being measured over too few blocks
+constexpr auto MIN_RATE_WINDOW = std::chrono::milliseconds(50);
+
+// Before any delivery there's nothing to base a deadline on
+constexpr auto INITIAL_REQUEST_TIMEOUT = std::chrono::seconds(20);
+
+// Peers serve requests from disk, a short stall isn't worth a re-request
+constexpr auto MIN_REQUEST_TIMEOUT = std::chrono::seconds(2);
+constexpr auto MAX_REQUEST_TIMEOUT = std::chrono::seconds(60);
+}  // namespace
+
+RequestPipeline::RequestPipeline(size_t initial_depth,
+                                 size_t min_depth,
+                                 size_t max_depth,
+                                 uint32_t block_bytes,
+                                 size_t snubbed_depth)
+    : m_depth {std::clamp(initial_depth, min_depth, max_depth)}
+    , m_min_depth {min_depth}
+    , m_max_depth {max_depth}
+    , m_block_bytes {block_bytes}
+    , m_snubbed_depth {snubbed_depth}
+{
+}
+
+void RequestPipeline::on_block_delivered(size_t bytes,
+                                         clock::time_point sent,
+                                         clock::time_point now)
+{
+  auto rtt = now - sent;
+
+  if (rtt <= m_min_rtt || now - m_min_rtt_timestamp > MIN_RTT_LIFETIME) {
+    m_min_rtt = rtt;
+    m_min_rtt_timestamp = now;
+  }
+
+  // RFC 6298 smoothing, over request-to-delivery latency
+  if (!m_smoothed_rtt) {
+    m_smoothed_rtt = rtt;
+    m_rtt_variance = rtt / 2;
+  } else {
+    auto deviation = rtt > *m_smoothed_rtt ? rtt - *m_smoothed_rtt
+                                           : *m_smoothed_rtt - rtt;
+
+    m_rtt_variance = (m_rtt_variance * 3 + deviation) / 4;
+    m_smoothed_rtt = (*m_smoothed_rtt * 7 + rtt) / 8;
+  }
+
+  // Rounds are timed from a delivery, the first one only opens the round
+  if (m_window_start == clock::time_point {}) {
+    m_window_start = now;
+    return;
+  }
+
+  m_window_bytes += bytes;
+
+  auto elapsed = now - m_window_start;
+
+  if (elapsed < std::max<clock::duration>(m_min_rtt, MIN_RATE_WINDOW)) {
+    return;
+  }
+
+  m_delivery_rate = static_cast<double>(m_window_bytes)
+      / std::chrono::duration<double>(elapsed).count();
+  m_window_start = now;
+  m_window_bytes = 0;
+
+  auto bdp = m_delivery_rate * std::chrono::duration<double>(m_min_rtt).count();
+  auto target = static_cast<size_t>(
+      std::ceil(PIPELINE_GAIN * bdp / static_cast<double>(m_block_bytes)));
+
+  m_depth = std::clamp(target, m_min_depth, m_max_depth);
+}
+
+void RequestPipeline::on_resumed()
+{
+  m_window_start = {};
+  m_window_bytes = 0;
+}
+
+void RequestPipeline::on_timed_out()
+{
+  m_snubbed = true;
+}
+
+void RequestPipeline::on_block_received()
+{
+  m_snubbed = false;
+}
+
+bool RequestPipeline::is_snubbed() const
+{
+  return m_snubbed;
+}
+
+size_t RequestPipeline::depth() const
+{
+  return m_snubbed ? m_snubbed_depth : m_depth;
+}
+
+RequestPipeline::clock::duration RequestPipeline::min_rtt() const
+{
+  return m_min_rtt;
+}
+
+RequestPipeline::clock::duration RequestPipeline::request_timeout() const
+{
+  if (!m_smoothed_rtt) {
+    return INITIAL_REQUEST_TIMEOUT;
+  }
+
+  return std::clamp<clock::duration>(*m_smoothed_rtt + 4 * m_rtt_variance,
+                                     MIN_REQUEST_TIMEOUT,
+                                     MAX_REQUEST_TIMEOUT);
+}
+
+double RequestPipeline::delivery_rate() const
+{
+  return m_delivery_rate;
+}
+}  // namespace btr
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace btr
+{
+/*
+ * Sizes a peer's outstanding request queue after its bandwidth-delay product.
+ * Every delivered block yields an RTT sample, and once per round trip the
+ * delivery rate over that round is measured. The queue is set to a multiple
+ * of rate * min RTT, so while the queue is what limits the rate the depth
+ * keeps doubling, and once the link is saturated it settles above the BDP.
+ * The min RTT is used because queued requests inflate the average one.
+ * That inflated latency is what a request has to wait for though, so its
+ * smoothed mean and deviation set how long a request may stay unanswered.
+ */
+class RequestPipeline
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+private:
+  size_t m_depth;
+  size_t m_min_depth;
+  size_t m_max_depth;
+  uint32_t m_block_bytes;
+
+  size_t m_snubbed_depth;
+  bool m_snubbed = false;
+
+  clock::duration m_min_rtt = clock::duration::max();
+  clock::time_point m_min_rtt_timestamp {};
+
+  std::optional<clock::duration> m_smoothed_rtt;
+  clock::duration m_rtt_variance {};
+
+  clock::time_point m_window_start {};
+  uint64_t m_window_bytes = 0;
+  double m_delivery_rate = 0;
+
+public:
+  RequestPipeline(size_t initial_depth,
+                  size_t min_depth,
+                  size_t max_depth,
+                  uint32_t block_bytes,
+                  size_t snubbed_depth = 1);
+
+  // A block requested at `sent` was delivered at `now`
+  void on_block_delivered(size_t bytes,
+                          clock::time_point sent,
+                          clock::time_point now);
+
+  // Requests go out after an idle period, which must not count as slow delivery
+  void on_resumed();
+
+  // Requests went unanswered past the timeout, the peer is snubbed and only
+  // probed with `snubbed_depth` requests until it delivers again
+  void on_timed_out();
+
+  // Any block counts, even one whose request already timed out
+  void on_block_received();
+
+  bool is_snubbed() const;
+
+  size_t depth() const;
+
+  clock::duration min_rtt() const;
+
+  // How long a request may go unanswered before the peer counts as stalled
+  clock::duration request_timeout() const;
+
+  // Bytes per second over the latest round trip
+  double delivery_rate() const;
+};
+}  // namespace btr
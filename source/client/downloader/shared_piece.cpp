@@ -0,0 +1,236 @@
+#include <algorithm>
+
+#include "client/downloader/shared_piece.hpp"
+
+namespace btr
+{
+SharedPiece::SharedPiece(std::shared_ptr<const InternalContext> context,
+                         std::shared_ptr<PiecePool> piece_pool,
+                         std::shared_ptr<IStorage> storage,
+                         uint32_t index,
+                         uint64_t part,
+                         SharedPiecePolicy policy)
+    : piece {.index = index,
+             .status = PieceStatus::Pending,
+             .data = {},
+             .bytes_downloaded = 0}
+    , blocks {context->get_piece_size(index), policy.max_block_bytes}
+    , requesters(blocks.block_count())
+    , streaming {context->piece_size > policy.max_buffered_piece_bytes}
+    , window_blocks {policy.streamed_window_blocks}
+    , storage_part {part}
+    , m_context {std::move(context)}
+    , m_piece_pool {std::move(piece_pool)}
+    , m_storage {std::move(storage)}
+{
+  if (streaming) {
+    piece.data.resize(window_blocks * policy.max_block_bytes);
+  } else {
+    piece.data = m_piece_pool->acquire(m_context->get_piece_size(index));
+  }
+}
+
+SharedPiece::~SharedPiece()
+{
+  if (streaming && !committed) {
+    m_storage->discard_piece(
+        m_context->info_hash_as_string(), piece.index, storage_part);
+  }
+
+  m_piece_pool->release(std::move(piece.data));
+}
+
+void SharedPiece::add_request(size_t block,
+                              BlockMap::clock::time_point now,
+                              IBlockRequester& requester)
+{
+  auto& holders = requesters[block];
+
+  blocks.mark_requested(block, now);
+
+  if (std::ranges::find(holders, &requester) == holders.end()) {
+    holders.push_back(&requester);
+  }
+}
+
+void SharedPiece::drop_request(size_t block, const IBlockRequester& requester)
+{
+  auto& holders = requesters[block];
+  auto holder = std::ranges::find(holders, &requester);
+
+  if (holder == holders.end()) {
+    return;
+  }
+
+  holders.erase(holder);
+
+  if (holders.empty()) {
+    blocks.mark_missing(block);
+  }
+}
+
+bool SharedPiece::receive(size_t block, const IBlockRequester& receiver)
+{
+  auto reader = in_transit.find(block);
+
+  if (blocks.state(block) == BlockState::Received
+      || (reader != in_transit.end() && reader->second != &receiver))
+  {
+    return false;
+  }
+
+  blocks.mark_received(block);
+
+  // Cancelling drops their requests, so they're walked on a copy
+  auto others = requesters[block];
+
+  for (auto* other : others) {
+    if (other != &receiver) {
+      other->cancel_block(static_cast<uint32_t>(piece.index), block);
+    }
+  }
+
+  return true;
+}
+
+std::optional<size_t> SharedPiece::next_block(const block_requests& own,
+                                              bool duplicate) const
+{
+  if (auto block = blocks.next_missing()) {
+    return block;
+  }
+
+  if (!duplicate) {
+    return std::nullopt;
+  }
+
+  for (size_t block = 0; block < blocks.block_count(); block++) {
+    if (blocks.state(block) == BlockState::Requested && !own.contains(block)) {
+      return block;
+    }
+  }
+
+  return std::nullopt;
+}
+
+bool SharedPiece::start_transit(size_t block, const IBlockRequester& reader)
+{
+  if (blocks.state(block) == BlockState::Received) {
+    return false;
+  }
+
+  return in_transit.emplace(block, &reader).second;
+}
+
+void SharedPiece::end_transit(size_t block, const IBlockRequester& reader)
+{
+  auto entry = in_transit.find(block);
+
+  if (entry != in_transit.end() && entry->second == &reader) {
+    in_transit.erase(entry);
+  }
+}
+
+uint64_t SharedPiece::missing_bytes() const
+{
+  uint64_t missing = 0;
+
+  for (size_t block = 0; block < blocks.block_count(); block++) {
+    if (blocks.state(block) != BlockState::Received) {
+      missing += blocks.block_length(block);
+    }
+  }
+
+  return missing;
+}
+
+PartialPieces::PartialPieces(std::shared_ptr<const InternalContext> context,
+                             std::shared_ptr<PiecePool> piece_pool,
+                             std::shared_ptr<IStorage> storage,
+                             SharedPiecePolicy policy)
+    : m_context {std::move(context)}
+    , m_piece_pool {std::move(piece_pool)}
+    , m_storage {std::move(storage)}
+    , m_policy {policy}
+{
+}
+
+std::shared_ptr<SharedPiece> PartialPieces::join(uint32_t index)
+{
+  auto& shared = m_pieces[index];
+
+  if (!shared) {
+    shared = std::make_shared<SharedPiece>(
+        m_context, m_piece_pool, m_storage, index, m_next_part++, m_policy);
+  }
+
+  return shared;
+}
+
+std::shared_ptr<SharedPiece> PartialPieces::find(uint32_t index) const
+{
+  auto entry = m_pieces.find(index);
+
+  return entry != m_pieces.end() ? entry->second : nullptr;
+}
+
+std::vector<uint32_t> PartialPieces::unclaimed() const
+{
+  std::vector<std::pair<size_t, uint32_t>> remaining;
+
+  for (const auto& [index, shared] : m_pieces) {
+    const auto& blocks = shared->blocks;
+
+    if (blocks.next_missing()) {
+      remaining.emplace_back(blocks.block_count() - blocks.blocks_received(),
+                             index);
+    }
+  }
+
+  std::ranges::sort(remaining);
+
+  std::vector<uint32_t> pieces;
+
+  for (auto [_, index] : remaining) {
+    pieces.push_back(index);
+  }
+
+  return pieces;
+}
+
+std::optional<FilePiece> PartialPieces::retrieve(uint32_t index)
+{
+  auto entry = m_pieces.find(index);
+
+  if (entry == m_pieces.end()
+      || entry->second->piece.status != PieceStatus::Complete)
+  {
+    return std::nullopt;
+  }
+
+  auto shared = std::move(entry->second);
+  m_pieces.erase(entry);
+
+  auto& piece = shared->piece;
+
+  // Every block was hashed on the pool as it arrived, only the digest is left
+  if (shared->hasher.finish() != m_context->piece_hashes[index]) {
+    piece.status = PieceStatus::Corrupt;
+  }
+
+  if (shared->streaming && piece.status == PieceStatus::Complete) {
+    m_storage->commit_piece(
+        m_context->info_hash_as_string(), index, shared->storage_part);
+
+    shared->committed = true;
+    piece.stored = true;
+  }
+
+  return std::move(piece);
+}
+
+uint32_t PartialPieces::block_bytes() const
+{
+  return m_policy.max_block_bytes;
+}
+}  // namespace btr
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include "client/context.hpp"
+#include "client/downloader/block_map.hpp"
+#include "client/downloader/piece_hasher.hpp"
+#include "client/downloader/piece_pool.hpp"
+#include "client/storage/storage.hpp"
+
+namespace btr
+{
+// A peer's outstanding requests for a piece's blocks, and when they went out
+using block_requests = std::map<size_t, BlockMap::clock::time_point>;
+
+// Whoever the blocks of a shared piece are requested through
+class IBlockRequester
+{
+public:
+  // Someone else delivered a block that was requested from this one as well
+  virtual void cancel_block(uint32_t index, size_t block) = 0;
+
+  virtual ~IBlockRequester() = default;
+};
+
+struct SharedPiecePolicy
+{
+  uint32_t max_block_bytes = 16 * 1024;
+
+  // Larger pieces aren't buffered whole, their blocks are written to storage
+  // as they arrive and read back a few at a time to be hashed
+  uint32_t max_buffered_piece_bytes = 8 * 1024 * 1024;
+  uint16_t streamed_window_blocks = 4;
+};
+
+/*
+ * A piece being downloaded, shared by every peer fetching it. Its blocks are
+ * handed out to whichever of them asks next, so peers cooperating on a piece
+ * never fetch the same block twice, except on purpose in endgame or when a
+ * deadline is at risk. A block goes back to Missing once no peer it was
+ * requested from is expected to deliver it anymore.
+ */
+struct SharedPiece
+{
+  FilePiece piece;
+  BlockMap blocks;
+
+  // Peers each block is currently requested from
+  std::vector<std::vector<IBlockRequester*>> requesters;
+
+  // Being read from a socket straight into `piece.data` by the given peer,
+  // nobody else may write these blocks meanwhile
+  std::map<size_t, const IBlockRequester*> in_transit;
+
+  // Hashed up to the first block that hasn't arrived yet
+  PieceHasher hasher;
+  size_t hashed_blocks = 0;
+  bool hashing = false;
+
+  // Written to storage under its own part as it downloads, `piece.data` is
+  // only a window of `window_blocks` the blocks are read back into for
+  // hashing
+  bool streaming;
+  size_t window_blocks;
+  uint64_t storage_part;
+  bool committed = false;
+
+  SharedPiece(std::shared_ptr<const InternalContext> context,
+              std::shared_ptr<PiecePool> piece_pool,
+              std::shared_ptr<IStorage> storage,
+              uint32_t index,
+              uint64_t part,
+              SharedPiecePolicy policy = {});
+
+  // Returns the buffer to the pool, and drops a part that wasn't committed
+  ~SharedPiece();
+
+  SharedPiece(const SharedPiece&) = delete;
+  SharedPiece& operator=(const SharedPiece&) = delete;
+
+  void add_request(size_t block,
+                   BlockMap::clock::time_point now,
+                   IBlockRequester& requester);
+
+  void drop_request(size_t block, const IBlockRequester& requester);
+
+  // Counts a block the first time it's delivered, cancelling it with every
+  // other peer it was requested from. While a peer reads it in place, only
+  // that peer's copy counts.
+  bool receive(size_t block, const IBlockRequester& receiver);
+
+  // Claims a block to be read in place, unless it arrived or is claimed
+  bool start_transit(size_t block, const IBlockRequester& reader);
+
+  // Gives up the claim, whether the read finished or stalled
+  void end_transit(size_t block, const IBlockRequester& reader);
+
+  // The next block to request from a peer with `own` requests outstanding.
+  // Blocks other peers were asked for are only requested again if
+  // `duplicate`, to race for a deadline or to finish the endgame.
+  std::optional<size_t> next_block(const block_requests& own,
+                                   bool duplicate) const;
+
+  uint64_t missing_bytes() const;
+
+private:
+  std::shared_ptr<const InternalContext> m_context;
+  std::shared_ptr<PiecePool> m_piece_pool;
+  std::shared_ptr<IStorage> m_storage;
+};
+
+/*
+ * The pieces started but not finished yet. A piece outlives the peers that
+ * fetched it, so the blocks they delivered aren't lost, and peers join the
+ * pieces that are closest to completion before starting new ones.
+ */
+class PartialPieces
+{
+  std::shared_ptr<const InternalContext> m_context;
+  std::shared_ptr<PiecePool> m_piece_pool;
+  std::shared_ptr<IStorage> m_storage;
+  SharedPiecePolicy m_policy;
+
+  std::map<uint32_t, std::shared_ptr<SharedPiece>> m_pieces;
+
+  // Every download of a piece writes to a part of its own
+  uint64_t m_next_part = 0;
+
+public:
+  PartialPieces(std::shared_ptr<const InternalContext> context,
+                std::shared_ptr<PiecePool> piece_pool,
+                std::shared_ptr<IStorage> storage,
+                SharedPiecePolicy policy = {});
+
+  // The piece's download, started if there's none yet
+  std::shared_ptr<SharedPiece> join(uint32_t index);
+
+  std::shared_ptr<SharedPiece> find(uint32_t index) const;
+
+  // Started pieces with blocks nobody was asked for, closest to done first
+  std::vector<uint32_t> unclaimed() const;
+
+  // Takes a piece that was completely hashed off the list, with its verdict
+  std::optional<FilePiece> retrieve(uint32_t index);
+
+  // The size blocks are requested in
+  uint32_t block_bytes() const;
+};
+}  // namespace btr
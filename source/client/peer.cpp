@@ -8,6 +8,7 @@
 
 #include "auxiliary/variant_aux.hpp"
 #include "client/transmit/transmit.hpp"
+#include "torrent/extension/extension.hpp"
 #include "torrent/messages.hpp"
 
 using boost::asio::awaitable;
@@ -40,10 +41,11 @@ void change_local_status(T, PeerStatus& status)
   }
 }
 
-void assign_bitfield(const std::vector<uint8_t>& raw_bitfield,
+void assign_bitfield(std::span<const uint8_t> raw_bitfield,
                      PeerStatus& status)
 {
-  status.remote_bitfield = aux::BitField {raw_bitfield};
+  status.remote_bitfield = aux::BitField {
+      std::vector<uint8_t>(raw_bitfield.begin(), raw_bitfield.end())};
 }
 
 void mark_bitfield(uint32_t index, PeerStatus& status)
@@ -51,16 +53,26 @@ void mark_bitfield(uint32_t index, PeerStatus& status)
   constexpr bool HAS_INDEX = true;
   status.remote_bitfield.mark(index, HAS_INDEX);
 }
+
+void assign_full_bitfield(uint32_t piece_count, PeerStatus& status)
+{
+  status.remote_bitfield =
+      aux::BitField {std::vector<uint8_t>((piece_count + 7) / 8, 0xff)};
+}
 }  // namespace
 
 Peer::Peer(std::shared_ptr<const InternalContext> context,
            PeerContactInfo peer_info,
            const boost::asio::any_io_executor& io,
-           size_t max_outgoing_messages)
+           PeerPolicy policy)
     : m_application_context {std::move(context)}
     , m_context {std::make_shared<ExternalPeerContext>(peer_info)}
-    , m_send_queue {io, max_outgoing_messages}
+    , m_policy {policy}
+    , m_send_queue {io, policy.max_outgoing_messages}
     , m_socket {io}
+    , m_receive_buffer {policy.receive_buffer_bytes}
+    , m_max_message_bytes {std::max<size_t>(
+          MAX_MESSAGE_BYTES, 1 + (m_application_context->piece_count + 7) / 8)}
 {
 }
 
@@ -74,14 +86,24 @@ const PeerActivity& Peer::get_activity() const
   return m_activity;
 }
 
-awaitable<void> Peer::start_async()
+awaitable<void> Peer::start_async(std::function<void()> on_connected)
 {
   if (!m_activity.is_active) {
     m_activity.is_active = true;
     m_is_stopping = false;
 
-    co_await connect_async();
-    co_await (receive_loop_async() && send_loop_async());
+    // A connection that failed or was stopped early must still read inactive
+    try {
+      co_await connect_within_deadline();
+
+      if (on_connected) {
+        on_connected();
+      }
+
+      co_await (receive_loop_async() && send_loop_async());
+    } catch (const std::exception& e) {
+      m_activity.receiver_exit_message = e.what();
+    }
 
     m_activity.is_active = false;
   }
@@ -92,16 +114,69 @@ awaitable<void> Peer::connect_async()
   co_await m_socket.async_connect(tcp::endpoint(m_context->contact_info.address,
                                                 m_context->contact_info.port),
                                   boost::asio::use_awaitable);
-  {
-    btr::Handshake handshake {*m_application_context};
 
-    co_await send_handshake(m_socket, handshake);
+  // We are only connected to when pieces are missing, so interest is declared
+  // upfront. A bitfield is valid with or without the Fast Extension, so the
+  // pieces we have go out before the remote handshake is known.
+  bool advertised = m_have_pieces && !m_have_pieces->is_empty();
+
+  m_send_batch.clear();
+
+  if (advertised) {
+    m_send_batch.push(TorrentMessage {BitField {m_have_pieces->as_raw()}});
+    m_send_batch.push(TorrentMessage {Interested {}});
   }
 
-  auto handshake = co_await read_handshake(m_socket);
+  co_await send_handshake(
+      m_socket, Handshake {*m_application_context}, m_send_batch);
+
+  auto handshake = co_await read_handshake(m_socket, m_receive_buffer);
 
   m_context->peer_id =
       std::string(handshake.peer_id, sizeof(handshake.peer_id));
+
+  m_context->status.fast_extension = handshake.supports_fast_extension();
+  m_context->status.extension_protocol =
+      handshake.supports_extension_protocol();
+
+  // Having nothing, we owe a HaveNone only if the Fast Extension is on. It
+  // must come before anything else, so interest is declared after it.
+  if (!advertised) {
+    if (m_context->status.fast_extension) {
+      try_send(TorrentMessage {HaveNone {}});
+    }
+
+    try_send(TorrentMessage {Interested {}});
+  }
+
+  m_context->status.self_interested = true;
+
+  // Flushed by the send loop along with the first requests
+  if (m_context->status.extension_protocol) {
+    try_send(TorrentMessage {make_extended_handshake()});
+  }
+}
+
+awaitable<void> Peer::connect_within_deadline()
+{
+  boost::asio::steady_timer deadline(co_await boost::asio::this_coro::executor,
+                                     m_policy.connect_timeout);
+
+  auto connected = co_await (
+      connect_async() || deadline.async_wait(boost::asio::use_awaitable));
+
+  if (connected.index() != 0) {
+    throw boost::system::system_error(boost::asio::error::timed_out);
+  }
+}
+
+void Peer::stop()
+{
+  m_is_stopping = true;
+
+  // Aborts what the loops are waiting for on the socket
+  boost::system::error_code ignored;
+  m_socket.close(ignored);
 }
 
 void Peer::add_callback(std::weak_ptr<message_callback> callback)
@@ -109,46 +184,166 @@ void Peer::add_callback(std::weak_ptr<message_callback> callback)
   m_callbacks.push_back(std::move(callback));
 }
 
-void Peer::handle_message(TorrentMessage message)
+void Peer::set_block_destination(
+    std::weak_ptr<block_destination_provider> provider)
+{
+  m_block_destination = std::move(provider);
+}
+
+void Peer::set_have_pieces(std::shared_ptr<const aux::BitField> have)
+{
+  m_have_pieces = std::move(have);
+}
+
+void Peer::handle_message(const TorrentMessage& message)
 {
   m_context->status.last_message_timestamp = std::chrono::steady_clock::now();
 
   std::visit(
       overloaded {
           [&](Keepalive) { handle_keep_alive(m_context->status); },
-          [&](auto status_message)
+          [&](const auto& status_message)
           { change_local_status(status_message, m_context->status); },
           [&](const Have& have)
           { mark_bitfield(have.piece_index, m_context->status); },
           [&](const BitField& bitfield)
           { assign_bitfield(bitfield.get_payload(), m_context->status); },
-          [](const Request&) {},
+          [&](const HaveAll&)
+          {
+            assign_full_bitfield(m_application_context->piece_count,
+                                 m_context->status);
+          },
+          [&](const HaveNone&) { m_context->status.remote_bitfield = {}; },
+          [&](const SuggestPiece& suggestion)
+          {
+            m_context->status.suggested_pieces.insert(suggestion.piece_index);
+          },
+          [&](const AllowedFast& allowed)
+          {
+            m_context->status.allowed_fast_pieces.insert(allowed.piece_index);
+          },
+          [&](const Request& request) { reject_request(request); },
           [](const Piece&) {},
           [](const Cancel&) {},
           [](const Port&) {},
+          [](const RejectRequest&) {},
+          [&](const Extended& extended) { handle_extended(extended); },
       },
       message);
 }
 
+void Peer::handle_extended(const Extended& extended)
+{
+  if (extended.get_metadata().extended_id != EXTENDED_HANDSHAKE_ID) {
+    return;
+  }
+
+  if (auto handshake = parse_extended_handshake(extended.get_payload())) {
+    m_context->status.remote_ut_pex_id = handshake->ut_pex_id;
+  }
+}
+
+void Peer::exchange_peers(std::span<const PeerContactInfo> swarm)
+{
+  auto id = m_context->status.remote_ut_pex_id;
+
+  if (!id) {
+    return;
+  }
+
+  auto delta = m_exchanged_peers.next(swarm);
+
+  // Whatever didn't fit, or wasn't sent, goes with the next exchange
+  if (!delta.empty()
+      && try_send(TorrentMessage {make_peer_exchange(*id, delta)}))
+  {
+    m_exchanged_peers.advance(delta);
+  }
+}
+
+void Peer::reject_request(const Request& request)
+{
+  // We never unchoke, so with the Fast Extension every request gets refused
+  if (m_context->status.fast_extension) {
+    try_send(TorrentMessage {RejectRequest {request.piece_index,
+                                            request.offset_within_piece,
+                                            request.length}});
+  }
+}
+
+awaitable<void> Peer::dispatch_message(const TorrentMessage& message)
+{
+  handle_message(message);
+
+  for (auto const& callback : m_callbacks) {
+    if (auto spt = callback.lock()) {
+      co_await (*spt)(message);
+    }
+  }
+}
+
+awaitable<void> Peer::receive_block_in_place()
+{
+  auto header = peek_piece_header(m_receive_buffer);
+  auto provider = m_block_destination.lock();
+
+  if (!header || !provider) {
+    co_return;
+  }
+
+  auto destination = (*provider)(*header);
+
+  if (destination.size() != header->block_length()) {
+    co_return;
+  }
+
+  auto buffered = m_receive_buffer.size() - sizeof(PieceMetadata);
+
+  boost::asio::steady_timer deadline(co_await boost::asio::this_coro::executor,
+                                     m_policy.block_read_timeout);
+
+  // Nobody else may deliver the block until the read finishes
+  auto read = co_await (
+      read_piece_into(m_socket, m_receive_buffer, destination)
+      || deadline.async_wait(boost::asio::use_awaitable));
+
+  if (read.index() != 0) {
+    throw boost::system::system_error(boost::asio::error::timed_out);
+  }
+
+  m_activity.bytes_received += destination.size() - buffered;
+
+  co_await dispatch_message(TorrentMessage {std::get<0>(std::move(read))});
+}
+
 awaitable<void> Peer::receive_loop_async()
 {
   m_activity.is_receiver_active = true;
 
   while (!m_is_stopping) {
     try {
-      if (auto message = co_await read_message(m_socket)) {
+      // Messages that arrived along with the handshake are handled right away
+      while (auto message =
+                 decode_message(m_receive_buffer, m_max_message_bytes))
+      {
+        if (*message) {
+          co_await dispatch_message(**message);
+          continue;
+        }
 
-        handle_message(*message);
+        m_activity.latest_parse_errors.push_back(message->error());
 
-        for (auto const& callback : m_callbacks) {
-          if (auto spt = callback.lock()) {
-            co_await (*spt)(*message);
-          }
+        if (message->error() == ParseError::TooLong) {
+          throw boost::system::system_error(boost::asio::error::message_size);
         }
-      } else {
-        m_activity.latest_parse_errors.push_back(message.error());
       }
 
+      co_await receive_block_in_place();
+
+      m_activity.bytes_received += co_await receive_some(
+          m_socket, m_receive_buffer, m_policy.max_read_bytes);
+      m_activity.receive_allocations = m_receive_buffer.allocations();
+
     } catch (const std::exception& e) {
       m_activity.receiver_exit_message = e.what();
       break;
@@ -171,11 +366,21 @@ awaitable<void> Peer::send_loop_async()
       auto message =
           co_await m_send_queue.async_receive(boost::asio::use_awaitable);
 
+      m_send_batch.clear();
+      m_send_batch.push(std::move(message));
+
+      while (m_send_batch.bytes() < m_policy.max_coalesced_write_bytes
+             && m_send_queue.try_receive(
+                 [this](boost::system::error_code, TorrentMessage next)
+                 { m_send_batch.push(std::move(next)); }))
+      {
+      }
+
       if (m_is_stopping) {
         break;
       }
 
-      co_await send_message(m_socket, message);
+      co_await send_messages(m_socket, m_send_batch);
 
     } catch (const std::exception& e) {
       m_activity.sender_exit_message = e.what();
@@ -187,10 +392,30 @@ awaitable<void> Peer::send_loop_async()
   m_activity.is_sender_active = false;
 }
 
+void Peer::track_outgoing(const TorrentMessage& message)
+{
+  if (std::holds_alternative<Interested>(message)) {
+    m_context->status.self_interested = true;
+  } else if (std::holds_alternative<NotInterested>(message)) {
+    m_context->status.self_interested = false;
+  }
+}
+
 awaitable<void> Peer::send_async(TorrentMessage message)
 {
-  co_await m_send_queue.async_send(
-      boost::system::error_code {}, message, boost::asio::use_awaitable);
+  track_outgoing(message);
+
+  co_await m_send_queue.async_send(boost::system::error_code {},
+                                   std::move(message),
+                                   boost::asio::use_awaitable);
+}
+
+bool Peer::try_send(TorrentMessage message)
+{
+  track_outgoing(message);
+
+  return m_send_queue.try_send(boost::system::error_code {},
+                               std::move(message));
 }
 
 awaitable<void> Peer::internal_stop_sender()
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <chrono>
 #include <functional>
 #include <memory>
+#include <span>
 
 #include <boost/asio.hpp>
 #include <boost/asio/experimental/awaitable_operators.hpp>
@@ -9,6 +11,7 @@
 #include <boost/circular_buffer.hpp>
 
 #include "client/context.hpp"
+#include "torrent/extension/extension.hpp"
 #include "torrent/messages.hpp"
 #include "transmit/transmit.hpp"
 
@@ -18,11 +21,29 @@ using channel_t = boost::asio::experimental::channel<void(
     boost::system::error_code, TorrentMessage)>;
 
 using message_callback =
-    std::function<boost::asio::awaitable<void>(TorrentMessage)>;
+    std::function<boost::asio::awaitable<void>(const TorrentMessage&)>;
+
+// Where the payload of an incoming block should land, empty if unexpected
+using block_destination_provider =
+    std::function<std::span<uint8_t>(const PieceMetadata&)>;
 
 using boost::asio::ip::address;
 using boost::asio::ip::port_type;
 
+struct PeerPolicy
+{
+  size_t max_outgoing_messages = 10;
+  size_t receive_buffer_bytes = 2 * DEFAULT_READ_BYTES;
+  size_t max_read_bytes = DEFAULT_READ_BYTES;
+  size_t max_coalesced_write_bytes = 64 * 1024;
+
+  // For the TCP connect and the handshake together, dead addresses time out
+  std::chrono::seconds connect_timeout {10};
+
+  // Reading the rest of a block in place, a peer stalling mid-block is dropped
+  std::chrono::seconds block_read_timeout {30};
+};
+
 struct PeerActivity
 {
   bool is_active = false;
@@ -33,27 +54,42 @@ struct PeerActivity
 
   std::string receiver_exit_message;
   std::string sender_exit_message;
+
+  uint64_t bytes_received = 0;
+  uint64_t receive_allocations = 0;
 };
 
 class Peer
 {
   std::shared_ptr<const InternalContext> m_application_context;
   std::shared_ptr<ExternalPeerContext> m_context;
+  PeerPolicy m_policy;
 
   channel_t m_send_queue;
 
   tcp::socket m_socket;
+  ReceiveBuffer m_receive_buffer;
+
+  // Longer messages close the connection instead of growing the buffer
+  size_t m_max_message_bytes;
+  SendBatch m_send_batch;
 
   PeerActivity m_activity;
   bool m_is_stopping = false;
 
   std::vector<std::weak_ptr<message_callback>> m_callbacks;
+  std::weak_ptr<block_destination_provider> m_block_destination;
+
+  // Pieces we have, advertised right after the handshake
+  std::shared_ptr<const aux::BitField> m_have_pieces;
+
+  PeerExchangeState m_exchanged_peers;
 
 public:
   Peer(std::shared_ptr<const InternalContext> context,
        PeerContactInfo peer_info,
        const boost::asio::any_io_executor& io,
-       size_t max_outgoing_messages = 10);
+       PeerPolicy policy = {});
 
   const ExternalPeerContext& get_context() const;
 
@@ -61,18 +97,46 @@ public:
 
   void add_callback(std::weak_ptr<message_callback>);
 
-  boost::asio::awaitable<void> start_async();
+  void set_block_destination(std::weak_ptr<block_destination_provider>);
+
+  void set_have_pieces(std::shared_ptr<const aux::BitField> have);
+
+  // `on_connected` runs once the handshakes were exchanged
+  boost::asio::awaitable<void> start_async(
+      std::function<void()> on_connected = {});
+
+  // Closes the connection, start_async returns once both loops exited
+  void stop();
 
   boost::asio::awaitable<void> send_async(TorrentMessage message);
 
+  // Queues without waiting, fails when the send queue is full
+  bool try_send(TorrentMessage message);
+
+  // Tells the peer how the rest of the swarm changed since it was last told,
+  // if it supports ut_pex
+  void exchange_peers(std::span<const PeerContactInfo> swarm);
+
 private:
   boost::asio::awaitable<void> connect_async();
 
+  boost::asio::awaitable<void> connect_within_deadline();
+
   boost::asio::awaitable<void> send_loop_async();
 
   boost::asio::awaitable<void> receive_loop_async();
 
-  void handle_message(TorrentMessage message);
+  void handle_message(const TorrentMessage& message);
+
+  void reject_request(const Request& request);
+
+  void handle_extended(const Extended& extended);
+
+  boost::asio::awaitable<void> dispatch_message(const TorrentMessage& message);
+
+  boost::asio::awaitable<void> receive_block_in_place();
+
+  void track_outgoing(const TorrentMessage& message);
 
   boost::asio::awaitable<void> internal_stop_sender();
 };
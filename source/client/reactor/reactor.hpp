@@ -31,6 +31,17 @@ public:
         std::make_unique<RandomPieceStrategy>(m_context, m_storage_device);
   }
 
+  // For a strategy of the caller's choosing, e.g. a StreamingStrategy it
+  // keeps moving the playback cursor of
+  Reactor(std::shared_ptr<InternalContext> context,
+          std::shared_ptr<IStorage> storage_device,
+          std::unique_ptr<IStrategy> strategy)
+      : m_context {std::move(context)}
+      , m_storage_device {std::move(storage_device)}
+      , m_strategy {std::move(strategy)}
+  {
+  }
+
   boost::asio::awaitable<void> download(std::string filepath,
                                         std::vector<Tracker>& trackers) const
   {
@@ -38,6 +49,8 @@ public:
 
     auto shared_io = std::make_shared<decltype(io)>(io);
 
+    co_await m_strategy->recheck();
+
     boost::asio::co_spawn(
         io,
         [&]() -> boost::asio::awaitable<void>
@@ -80,14 +93,19 @@ public:
 
       std::cout << "Finished assigning\n";
 
+      // Completed pieces are stored and their peers reassigned as soon as
+      // they finish, stalled peers are only looked for every few seconds
+      auto next_revoke = std::chrono::steady_clock::now() + 3s;
+
       while (true) {
-        boost::asio::steady_timer timer(
-            co_await boost::asio::this_coro::executor);
-        timer.expires_from_now(3s);
+        co_await m_strategy->complete(next_revoke
+                                      - std::chrono::steady_clock::now());
 
-        co_await timer.async_wait(boost::asio::use_awaitable);
+        if (std::chrono::steady_clock::now() >= next_revoke) {
+          co_await m_strategy->revoke();
+          next_revoke = std::chrono::steady_clock::now() + 3s;
+        }
 
-        co_await m_strategy->revoke();
         co_await m_strategy->assign();
 
         if (co_await m_strategy->is_done()) {
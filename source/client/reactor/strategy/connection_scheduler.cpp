@@ -0,0 +1,145 @@
+#include <algorithm>
+
+#include "client/reactor/strategy/connection_scheduler.hpp"
+
+namespace btr
+{
+ConnectionScheduler::ConnectionScheduler(ConnectionSchedulerPolicy policy)
+    : m_policy {policy}
+{
+}
+
+void ConnectionScheduler::add(const PeerContactInfo& contact,
+                              clock::time_point now)
+{
+  auto& history = m_contacts[contact];
+
+  if (history.queued || history.connecting || history.connected
+      || history.given_up || history.retry_at > now)
+  {
+    return;
+  }
+
+  history.queued = true;
+  m_ready.push_back(contact);
+}
+
+std::optional<PeerContactInfo> ConnectionScheduler::next(clock::time_point now)
+{
+  // Contacts whose backoff ran out line up behind the waiting ones
+  while (!m_backing_off.empty() && m_backing_off.begin()->first <= now) {
+    auto contact = m_backing_off.begin()->second;
+    m_backing_off.erase(m_backing_off.begin());
+
+    add(contact, now);
+  }
+
+  while (m_half_open < m_policy.max_half_open && !m_ready.empty()) {
+    auto contact = m_ready.front();
+    m_ready.pop_front();
+
+    auto& history = m_contacts[contact];
+    history.queued = false;
+
+    // Given up on while it was waiting
+    if (history.given_up) {
+      continue;
+    }
+
+    history.connecting = true;
+    m_half_open++;
+
+    return contact;
+  }
+
+  return std::nullopt;
+}
+
+void ConnectionScheduler::on_connected(const PeerContactInfo& contact)
+{
+  auto history = m_contacts.find(contact);
+
+  if (history == m_contacts.end() || !history->second.connecting) {
+    return;
+  }
+
+  m_half_open--;
+
+  history->second.connecting = false;
+  history->second.connected = true;
+  history->second.failures = 0;
+}
+
+void ConnectionScheduler::on_failed(const PeerContactInfo& contact,
+                                    clock::time_point now)
+{
+  auto history = m_contacts.find(contact);
+
+  if (history == m_contacts.end() || !history->second.connecting) {
+    return;
+  }
+
+  m_half_open--;
+
+  auto& failed = history->second;
+  failed.connecting = false;
+
+  if (++failed.failures >= m_policy.max_failures) {
+    failed.given_up = true;
+    return;
+  }
+
+  auto doublings = std::min(failed.failures - 1, 16);
+  auto backoff = std::min<clock::duration>(
+      m_policy.initial_backoff * (1 << doublings), m_policy.max_backoff);
+
+  back_off(contact, failed, now + backoff);
+}
+
+void ConnectionScheduler::on_closed(const PeerContactInfo& contact,
+                                    clock::time_point now)
+{
+  auto history = m_contacts.find(contact);
+
+  if (history == m_contacts.end() || !history->second.connected) {
+    return;
+  }
+
+  history->second.connected = false;
+  back_off(contact, history->second, now + m_policy.initial_backoff);
+}
+
+void ConnectionScheduler::give_up(const PeerContactInfo& contact)
+{
+  m_contacts[contact].given_up = true;
+}
+
+size_t ConnectionScheduler::half_open() const
+{
+  return m_half_open;
+}
+
+size_t ConnectionScheduler::waiting() const
+{
+  return m_ready.size();
+}
+
+uint8_t ConnectionScheduler::failures(const PeerContactInfo& contact) const
+{
+  auto history = m_contacts.find(contact);
+
+  return history != m_contacts.end() ? history->second.failures : 0;
+}
+
+void ConnectionScheduler::back_off(const PeerContactInfo& contact,
+                                   ContactHistory& history,
+                                   clock::time_point until)
+{
+  if (history.given_up) {
+    return;
+  }
+
+  history.retry_at = until;
+  m_backing_off.emplace(until, contact);
+}
+}  // namespace btr
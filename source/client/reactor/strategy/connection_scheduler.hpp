@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <optional>
+
+#include "client/context.hpp"
+
+namespace btr
+{
+struct ConnectionSchedulerPolicy
+{
+  // Connects in flight at once, the other contacts wait their turn
+  size_t max_half_open = 8;
+
+  // Before a contact is tried again, doubling with each failure in a row
+  std::chrono::seconds initial_backoff {30};
+  std::chrono::seconds max_backoff {30 * 60};
+
+  // Contacts failing this often in a row are given up on
+  uint8_t max_failures = 6;
+};
+
+/*
+ * Decides which contacts are connected to, and when. Contacts queue up in
+ * the order they were learned, and only a few connects are in flight at a
+ * time. A contact that failed is held back for a while, twice as long with
+ * each failure in a row, so dead addresses stop competing with live ones
+ * for connects. Contacts that keep failing, or were given up on, are never
+ * tried again.
+ */
+class ConnectionScheduler
+{
+public:
+  using clock = std::chrono::steady_clock;
+
+private:
+  struct ContactHistory
+  {
+    uint8_t failures = 0;
+    clock::time_point retry_at {};
+
+    bool queued = false;
+    bool connecting = false;
+    bool connected = false;
+    bool given_up = false;
+  };
+
+  ConnectionSchedulerPolicy m_policy;
+
+  std::map<PeerContactInfo, ContactHistory> m_contacts;
+  std::deque<PeerContactInfo> m_ready;
+  std::multimap<clock::time_point, PeerContactInfo> m_backing_off;
+
+  size_t m_half_open = 0;
+
+public:
+  ConnectionScheduler(ConnectionSchedulerPolicy policy = {});
+
+  // Queued unless it's in use, backing off or given up on
+  void add(const PeerContactInfo& contact, clock::time_point now);
+
+  // The contact to connect to next, if another connect may be in flight
+  std::optional<PeerContactInfo> next(clock::time_point now);
+
+  void on_connected(const PeerContactInfo& contact);
+
+  void on_failed(const PeerContactInfo& contact, clock::time_point now);
+
+  // An established connection ended, the contact may be retried later
+  void on_closed(const PeerContactInfo& contact, clock::time_point now);
+
+  void give_up(const PeerContactInfo& contact);
+
+  size_t half_open() const;
+
+  // Contacts ready to be connected to
+  size_t waiting() const;
+
+  uint8_t failures(const PeerContactInfo& contact) const;
+
+private:
+  void back_off(const PeerContactInfo& contact,
+                ContactHistory& history,
+                clock::time_point until);
+};
+}  // namespace btr
@@ -0,0 +1,88 @@
+#include <algorithm>
+
+#include "client/reactor/strategy/deadlines.hpp"
+
+namespace btr
+{
+namespace
+{
+// Further out is as good as never, and stays clear of overflowing the clock
+constexpr auto MAX_DEADLINE_DISTANCE = std::chrono::hours(24 * 365);
+}  // namespace
+
+deadline_clock::time_point playback_deadline(deadline_clock::time_point now,
+                                             uint64_t ahead_bytes,
+                                             double bytes_per_second)
+{
+  // Also catches NaN
+  if (!(bytes_per_second > 0)) {
+    return deadline_clock::time_point::max();
+  }
+
+  std::chrono::duration<double> distance {static_cast<double>(ahead_bytes)
+                                          / bytes_per_second};
+
+  if (distance >= MAX_DEADLINE_DISTANCE) {
+    return deadline_clock::time_point::max();
+  }
+
+  return now
+      + std::chrono::duration_cast<deadline_clock::duration>(distance);
+}
+
+bool deadline_at_risk(uint64_t remaining_bytes,
+                      double rate,
+                      deadline_clock::time_point deadline,
+                      deadline_clock::time_point now)
+{
+  if (remaining_bytes == 0) {
+    return false;
+  }
+
+  if (now >= deadline) {
+    return true;
+  }
+
+  if (rate <= 0) {
+    return false;
+  }
+
+  return static_cast<double>(remaining_bytes) / rate
+      > std::chrono::duration<double>(deadline - now).count();
+}
+
+std::vector<uint32_t> earliest_deadlines(
+    const std::map<uint32_t, deadline_clock::time_point>& deadlines,
+    const std::set<uint32_t>& missing)
+{
+  std::vector<uint32_t> pieces;
+
+  for (const auto& [index, _] : deadlines) {
+    if (missing.contains(index)) {
+      pieces.push_back(index);
+    }
+  }
+
+  // Equal deadlines keep the order of the pieces
+  std::ranges::stable_sort(
+      pieces, {}, [&deadlines](uint32_t index) { return deadlines.at(index); });
+
+  return pieces;
+}
+
+uint64_t playable_bytes(const InternalContext& context,
+                        uint64_t cursor,
+                        const std::set<uint32_t>& missing)
+{
+  auto index = static_cast<uint32_t>(cursor / context.piece_size);
+  auto end = cursor;
+
+  while (index < context.piece_count && !missing.contains(index)) {
+    end = uint64_t {index} * context.piece_size
+        + context.get_piece_size(index);
+    index++;
+  }
+
+  return end - cursor;
+}
+}  // namespace btr
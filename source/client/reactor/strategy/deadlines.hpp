@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "client/context.hpp"
+
+namespace btr
+{
+using deadline_clock = std::chrono::steady_clock;
+
+// When playback, consuming `bytes_per_second`, gets `ahead_bytes` past its
+// cursor. Paused playback never gets there, its pieces are due at the end
+// of time and keep their order only through their indices.
+deadline_clock::time_point playback_deadline(deadline_clock::time_point now,
+                                             uint64_t ahead_bytes,
+                                             double bytes_per_second);
+
+// Whether `remaining_bytes`, arriving at `rate` bytes per second, miss the
+// deadline. Downloads that didn't deliver yet are left to the request
+// timeouts until the deadline passed.
+bool deadline_at_risk(uint64_t remaining_bytes,
+                      double rate,
+                      deadline_clock::time_point deadline,
+                      deadline_clock::time_point now);
+
+// The missing pieces among those with a deadline, earliest deadline first
+std::vector<uint32_t> earliest_deadlines(
+    const std::map<uint32_t, deadline_clock::time_point>& deadlines,
+    const std::set<uint32_t>& missing);
+
+// Bytes from `cursor` on up to the first missing piece
+uint64_t playable_bytes(const InternalContext& context,
+                        uint64_t cursor,
+                        const std::set<uint32_t>& missing);
+}  // namespace btr
@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <cmath>
+
+#include "client/reactor/strategy/peer_manager.hpp"
+
+namespace btr
+{
+ConnectionBudget::ConnectionBudget(size_t max_connections)
+    : m_max_connections {max_connections}
+{
+}
+
+std::shared_ptr<ConnectionBudget> ConnectionBudget::shared()
+{
+  static auto budget =
+      std::make_shared<ConnectionBudget>(DEFAULT_MAX_CONNECTIONS);
+
+  return budget;
+}
+
+bool ConnectionBudget::available() const
+{
+  return m_connections < m_max_connections;
+}
+
+void ConnectionBudget::acquire()
+{
+  m_connections++;
+}
+
+void ConnectionBudget::release()
+{
+  if (m_connections > 0) {
+    m_connections--;
+  }
+}
+
+size_t ConnectionBudget::connections() const
+{
+  return m_connections;
+}
+
+PeerManager::PeerManager(PeerManagerPolicy policy,
+                         std::shared_ptr<ConnectionBudget> budget)
+    : m_policy {policy}
+    , m_budget {std::move(budget)}
+{
+}
+
+PeerManager::~PeerManager()
+{
+  for (size_t i = 0; i < m_peers.size(); i++) {
+    m_budget->release();
+  }
+}
+
+bool PeerManager::has_room() const
+{
+  return m_peers.size() < m_policy.max_connections && m_budget->available();
+}
+
+void PeerManager::connected(peer_key peer, clock::time_point now)
+{
+  if (m_peers.try_emplace(peer, PeerRate {now, now}).second) {
+    m_budget->acquire();
+  }
+}
+
+void PeerManager::disconnected(peer_key peer)
+{
+  if (m_peers.erase(peer) > 0) {
+    m_budget->release();
+  }
+}
+
+void PeerManager::record(peer_key peer,
+                         uint64_t bytes_received,
+                         clock::time_point now)
+{
+  auto entry = m_peers.find(peer);
+
+  if (entry == m_peers.end() || now <= entry->second.sampled_at) {
+    return;
+  }
+
+  auto& peer_rate = entry->second;
+
+  auto elapsed = std::chrono::duration<double>(now - peer_rate.sampled_at);
+  auto delivered = bytes_received > peer_rate.bytes_received
+      ? bytes_received - peer_rate.bytes_received
+      : 0;
+
+  // Weighted by the time the sample covers, so uneven sampling doesn't skew
+  auto weight = 1.0
+      - std::exp2(-elapsed.count()
+                  / std::chrono::duration<double>(m_policy.rate_half_life)
+                        .count());
+
+  auto sample = static_cast<double>(delivered) / elapsed.count();
+
+  peer_rate.rate += weight * (sample - peer_rate.rate);
+  peer_rate.bytes_received = bytes_received;
+  peer_rate.sampled_at = now;
+}
+
+double PeerManager::rate(peer_key peer) const
+{
+  auto entry = m_peers.find(peer);
+
+  return entry != m_peers.end() ? entry->second.rate : 0;
+}
+
+size_t PeerManager::connections() const
+{
+  return m_peers.size();
+}
+
+std::vector<PeerManager::peer_key> PeerManager::select_turnover(
+    size_t waiting_candidates, clock::time_point now)
+{
+  if (waiting_candidates == 0 || now < m_next_turnover) {
+    return {};
+  }
+
+  m_next_turnover = now + m_policy.turnover_interval;
+
+  auto cutoff = m_policy.turnover_cutoff
+      * static_cast<double>(m_policy.max_connections);
+
+  if (static_cast<double>(m_peers.size()) < cutoff && m_budget->available()) {
+    return {};
+  }
+
+  std::vector<std::pair<double, peer_key>> rated;
+
+  for (const auto& [peer, peer_rate] : m_peers) {
+    if (now - peer_rate.connected_at >= m_policy.min_connection_age) {
+      rated.emplace_back(peer_rate.rate, peer);
+    }
+  }
+
+  auto share = static_cast<size_t>(m_policy.turnover
+                                   * static_cast<double>(m_peers.size()));
+  auto count = std::min(
+      {waiting_candidates, rated.size(), std::max<size_t>(share, 1)});
+
+  std::ranges::partial_sort(rated,
+                            rated.begin() + static_cast<std::ptrdiff_t>(count));
+
+  std::vector<peer_key> slowest;
+
+  for (size_t i = 0; i < count; i++) {
+    slowest.push_back(rated[i].second);
+  }
+
+  return slowest;
+}
+}  // namespace btr
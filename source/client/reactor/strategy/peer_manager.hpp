@@ -0,0 +1,116 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace btr
+{
+/*
+ * Connections every torrent of the process draws from, so the sockets and
+ * coroutines of many torrents don't add up without bound.
+ */
+class ConnectionBudget
+{
+  size_t m_max_connections;
+  size_t m_connections = 0;
+
+public:
+  static constexpr size_t DEFAULT_MAX_CONNECTIONS = 200;
+
+  ConnectionBudget(size_t max_connections);
+
+  // The one shared by the process, with the default limit
+  static std::shared_ptr<ConnectionBudget> shared();
+
+  bool available() const;
+
+  void acquire();
+
+  void release();
+
+  size_t connections() const;
+};
+
+struct PeerManagerPolicy
+{
+  // Connections of a single torrent, the budget may allow fewer
+  size_t max_connections = 50;
+
+  // A peer's download rate is averaged with a weight halving every so often
+  std::chrono::seconds rate_half_life {10};
+
+  // Peers are only compared once their rate had time to ramp up
+  std::chrono::seconds min_connection_age {30};
+
+  // How often the slowest peers are replaced, and which share of them
+  std::chrono::seconds turnover_interval {60};
+  double turnover = 0.1;
+
+  // Below this share of the limit there's room for fresh peers anyway
+  double turnover_cutoff = 0.9;
+};
+
+/*
+ * Keeps a torrent's connections to the peers that deliver the most. Each
+ * peer's download rate is an exponentially weighted moving average of the
+ * bytes it delivered between samples. While the torrent is close to its
+ * connection limit and fresh candidates are waiting, the slowest peers are
+ * periodically picked to be disconnected, so the candidates can take their
+ * place and the swarm we keep drifts towards its fastest members.
+ */
+class PeerManager
+{
+public:
+  using peer_key = const void*;
+  using clock = std::chrono::steady_clock;
+
+private:
+  struct PeerRate
+  {
+    clock::time_point connected_at;
+    clock::time_point sampled_at;
+    uint64_t bytes_received = 0;
+    double rate = 0;
+  };
+
+  PeerManagerPolicy m_policy;
+  std::shared_ptr<ConnectionBudget> m_budget;
+
+  std::unordered_map<peer_key, PeerRate> m_peers;
+  clock::time_point m_next_turnover {};
+
+public:
+  PeerManager(PeerManagerPolicy policy = {},
+              std::shared_ptr<ConnectionBudget> budget =
+                  ConnectionBudget::shared());
+
+  // Its connections go back to the budget
+  ~PeerManager();
+
+  PeerManager(const PeerManager&) = delete;
+  PeerManager& operator=(const PeerManager&) = delete;
+
+  // Whether both the torrent and the budget allow another connection
+  bool has_room() const;
+
+  void connected(peer_key peer, clock::time_point now);
+
+  void disconnected(peer_key peer);
+
+  // The peer received `bytes_received` in total by `now`
+  void record(peer_key peer, uint64_t bytes_received, clock::time_point now);
+
+  // Bytes per second, averaged
+  double rate(peer_key peer) const;
+
+  size_t connections() const;
+
+  // The peers to disconnect in favour of `waiting_candidates`, slowest first
+  std::vector<peer_key> select_turnover(size_t waiting_candidates,
+                                        clock::time_point now);
+};
+}  // namespace btr
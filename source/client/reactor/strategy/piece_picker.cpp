@@ -0,0 +1,261 @@
+#include <algorithm>
+#include <cmath>
+#include <tuple>
+
+#include "client/reactor/strategy/piece_picker.hpp"
+
+namespace btr
+{
+namespace
+{
+// Below this, a peer's candidates are cheaper to look through than buckets
+constexpr size_t MIN_DENSE_CANDIDATES = 64;
+}  // namespace
+
+PiecePicker::PiecePicker(uint32_t piece_count, PiecePickerPolicy policy)
+    : m_policy {policy}
+    , m_pieces(piece_count)
+    , m_dense_candidates {std::max(
+          MIN_DENSE_CANDIDATES,
+          static_cast<size_t>(std::sqrt(static_cast<double>(piece_count))))}
+{
+}
+
+void PiecePicker::add_peer(peer_key peer)
+{
+  m_peers.try_emplace(peer);
+}
+
+void PiecePicker::remove_peer(peer_key peer)
+{
+  auto entry = m_peers.find(peer);
+
+  if (entry == m_peers.end()) {
+    return;
+  }
+
+  for (uint32_t index = 0; index < m_pieces.size(); index++) {
+    count_peer_piece(entry->second, index, false);
+  }
+
+  m_peers.erase(entry);
+}
+
+void PiecePicker::peer_has(peer_key peer, uint32_t index)
+{
+  auto entry = m_peers.find(peer);
+
+  if (entry != m_peers.end() && index < m_pieces.size()) {
+    count_peer_piece(entry->second, index, true);
+  }
+}
+
+void PiecePicker::set_peer_pieces(peer_key peer, const aux::BitField& pieces)
+{
+  auto entry = m_peers.find(peer);
+
+  if (entry == m_peers.end()) {
+    return;
+  }
+
+  for (uint32_t index = 0; index < m_pieces.size(); index++) {
+    count_peer_piece(entry->second, index, pieces.get(index));
+  }
+}
+
+void PiecePicker::mark_have(uint32_t index)
+{
+  unlink(index);
+  m_pieces[index].missing = false;
+}
+
+void PiecePicker::add_downloader(uint32_t index)
+{
+  auto& piece = m_pieces[index];
+
+  unlink(index);
+
+  if (piece.downloaders < UINT8_MAX) {
+    piece.downloaders++;
+  }
+
+  link(index);
+}
+
+void PiecePicker::remove_downloader(uint32_t index)
+{
+  auto& piece = m_pieces[index];
+
+  unlink(index);
+
+  if (piece.downloaders > 0) {
+    piece.downloaders--;
+  }
+
+  link(index);
+}
+
+void PiecePicker::set_priority(uint32_t index, uint8_t priority)
+{
+  unlink(index);
+  m_pieces[index].priority = std::min<uint8_t>(priority, PRIORITY_LEVELS - 1);
+  link(index);
+}
+
+uint32_t PiecePicker::availability(uint32_t index) const
+{
+  return m_pieces[index].availability;
+}
+
+std::optional<uint32_t> PiecePicker::pick(peer_key peer,
+                                          std::span<const uint32_t> exclude,
+                                          bool unclaimed_only)
+{
+  auto entry = m_peers.find(peer);
+
+  if (entry == m_peers.end()) {
+    return std::nullopt;
+  }
+
+  auto& pieces = entry->second;
+
+  auto eligible = [&](uint32_t index)
+  {
+    const auto& piece = m_pieces[index];
+
+    return is_pickable(piece) && pieces.has.get(index)
+        && (!unclaimed_only || piece.downloaders == 0)
+        && !std::ranges::contains(exclude, index);
+  };
+
+  if (pieces.dense) {
+    for (const auto& level : m_buckets) {
+      for (const auto& bucket : level) {
+        for (auto index : bucket) {
+          if (eligible(index)) {
+            return index;
+          }
+        }
+      }
+    }
+
+    return std::nullopt;
+  }
+
+  // The order buckets are looked through in, with the random order within one
+  auto rank = [this](uint32_t index)
+  {
+    const auto& piece = m_pieces[index];
+
+    return std::tuple {-int {piece.priority},
+                       m_policy.rarest_first ? piece.availability : 0,
+                       piece.position};
+  };
+
+  std::optional<uint32_t> best;
+
+  for (size_t i = 0; i < pieces.candidates.size();) {
+    auto index = pieces.candidates[i];
+
+    // Pieces we got since are dropped on the way
+    if (!m_pieces[index].missing || !pieces.has.get(index)) {
+      pieces.candidates[i] = pieces.candidates.back();
+      pieces.candidates.pop_back();
+      continue;
+    }
+
+    if (eligible(index) && (!best || rank(index) < rank(*best))) {
+      best = index;
+    }
+
+    i++;
+  }
+
+  return best;
+}
+
+bool PiecePicker::is_pickable(const PieceState& piece) const
+{
+  return piece.missing && piece.availability > 0
+      && piece.downloaders < m_policy.max_downloaders;
+}
+
+std::vector<uint32_t>& PiecePicker::bucket_of(const PieceState& piece)
+{
+  auto& level = m_buckets[PRIORITY_LEVELS - 1 - piece.priority];
+  auto availability = m_policy.rarest_first ? piece.availability : 0;
+
+  if (level.size() <= availability) {
+    level.resize(availability + 1);
+  }
+
+  return level[availability];
+}
+
+void PiecePicker::link(uint32_t index)
+{
+  auto& piece = m_pieces[index];
+
+  if (!is_pickable(piece)) {
+    return;
+  }
+
+  auto& bucket = bucket_of(piece);
+  auto position = std::uniform_int_distribution<size_t> {
+      0, bucket.size()}(m_random);
+
+  // Swapped into a random place, which keeps the bucket shuffled
+  bucket.push_back(index);
+  std::swap(bucket[position], bucket.back());
+
+  m_pieces[bucket[position]].position = static_cast<uint32_t>(position);
+  m_pieces[bucket.back()].position = static_cast<uint32_t>(bucket.size() - 1);
+}
+
+void PiecePicker::unlink(uint32_t index)
+{
+  auto& piece = m_pieces[index];
+
+  if (!is_pickable(piece)) {
+    return;
+  }
+
+  auto& bucket = bucket_of(piece);
+  auto moved = bucket.back();
+
+  bucket[piece.position] = moved;
+  m_pieces[moved].position = piece.position;
+  bucket.pop_back();
+}
+
+void PiecePicker::count_peer_piece(PeerPieces& peer, uint32_t index, bool has)
+{
+  if (peer.has.get(index) == has) {
+    return;
+  }
+
+  peer.has.mark(index, has);
+
+  unlink(index);
+
+  if (has) {
+    m_pieces[index].availability++;
+  } else {
+    m_pieces[index].availability--;
+  }
+
+  link(index);
+
+  if (!has || !m_pieces[index].missing || peer.dense) {
+    return;
+  }
+
+  peer.candidates.push_back(index);
+
+  // From here on scanning the buckets finds one of its pieces quickly
+  if (peer.candidates.size() > m_dense_candidates) {
+    peer.dense = true;
+    peer.candidates = {};
+  }
+}
+}  // namespace btr
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include "torrent/bitfield/bitfield.hpp"
+
+namespace btr
+{
+struct PiecePickerPolicy
+{
+  // Peers downloading one piece side by side, outside of endgame
+  uint8_t max_downloaders = 2;
+
+  // Rarer pieces go first. Otherwise availability is ignored and pieces are
+  // picked at random, as RandomPieceStrategy does.
+  bool rarest_first = true;
+};
+
+/*
+ * Index of the pieces that may be handed to a peer. Pickable pieces, missing
+ * ones some peer has that aren't downloaded by enough peers yet, sit in
+ * buckets by priority and then availability. A bucket is kept in random
+ * order and a piece moves between buckets in constant time, so the first
+ * piece a peer has in the first bucket is a random pick among the best.
+ *
+ * Picking for a peer that has most pieces only looks at a few of the first
+ * bucketed ones. A peer with few of our missing pieces keeps them as its
+ * candidates instead, and those are all it looks at.
+ */
+class PiecePicker
+{
+public:
+  using peer_key = const void*;
+
+  static constexpr uint8_t PRIORITY_LEVELS = 4;
+
+private:
+  struct PieceState
+  {
+    uint32_t availability = 0;
+    uint8_t priority = 0;
+    uint8_t downloaders = 0;
+    bool missing = true;
+
+    // Within its bucket, while pickable
+    uint32_t position = 0;
+  };
+
+  struct PeerPieces
+  {
+    aux::BitField has;
+
+    // Missing pieces it has, only tracked while there are few of them
+    std::vector<uint32_t> candidates;
+    bool dense = false;
+  };
+
+  PiecePickerPolicy m_policy;
+  std::vector<PieceState> m_pieces;
+
+  // By priority, highest first, then by availability
+  std::array<std::vector<std::vector<uint32_t>>, PRIORITY_LEVELS> m_buckets;
+
+  std::unordered_map<peer_key, PeerPieces> m_peers;
+  size_t m_dense_candidates;
+
+  std::mt19937 m_random {std::random_device {}()};
+
+public:
+  PiecePicker(uint32_t piece_count, PiecePickerPolicy policy = {});
+
+  void add_peer(peer_key peer);
+
+  // Its pieces don't count towards availability anymore
+  void remove_peer(peer_key peer);
+
+  // The peer announced a piece
+  void peer_has(peer_key peer, uint32_t index);
+
+  // The peer's pieces were announced all at once
+  void set_peer_pieces(peer_key peer, const aux::BitField& pieces);
+
+  // The piece was verified and stored, it's never picked again
+  void mark_have(uint32_t index);
+
+  void add_downloader(uint32_t index);
+
+  void remove_downloader(uint32_t index);
+
+  // Pieces of a higher priority are picked before any of a lower one
+  void set_priority(uint32_t index, uint8_t priority);
+
+  uint32_t availability(uint32_t index) const;
+
+  // The best piece for the peer, other than those it already downloads.
+  // When `unclaimed_only`, only a piece nobody downloads yet.
+  std::optional<uint32_t> pick(peer_key peer,
+                               std::span<const uint32_t> exclude,
+                               bool unclaimed_only = false);
+
+private:
+  bool is_pickable(const PieceState& piece) const;
+
+  std::vector<uint32_t>& bucket_of(const PieceState& piece);
+
+  void link(uint32_t index);
+
+  void unlink(uint32_t index);
+
+  void count_peer_piece(PeerPieces& peer, uint32_t index, bool has);
+};
+}  // namespace btr
@@ -1,13 +1,24 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <limits>
 #include <map>
+#include <optional>
 #include <ranges>
 #include <set>
+#include <span>
 
+#include "auxiliary/variant_aux.hpp"
 #include "client/downloader/downloader.hpp"
 #include "client/peer.hpp"
+#include "client/reactor/strategy/connection_scheduler.hpp"
+#include "client/reactor/strategy/deadlines.hpp"
+#include "client/reactor/strategy/peer_manager.hpp"
+#include "client/reactor/strategy/piece_picker.hpp"
 #include "client/storage/storage.hpp"
+#include "torrent/extension/extension.hpp"
 
 namespace btr
 {
@@ -15,6 +26,10 @@ namespace btr
 class IStrategy
 {
 public:
+  // Verifies the pieces found in storage, those that don't match their hash
+  // are downloaded again. Runs before anything else.
+  virtual boost::asio::awaitable<void> recheck() = 0;
+
   virtual boost::asio::awaitable<void> include(
       const std::vector<PeerContactInfo>& potential_peers) = 0;
 
@@ -22,6 +37,10 @@ public:
 
   virtual boost::asio::awaitable<void> revoke() = 0;
 
+  // Waits up to `timeout` for pieces to complete, storing those that did
+  virtual boost::asio::awaitable<void> complete(
+      std::chrono::steady_clock::duration timeout) = 0;
+
   virtual boost::asio::awaitable<bool> is_done() = 0;
 
   virtual ~IStrategy() = default;
@@ -29,25 +48,138 @@ public:
 
 class RandomPieceStrategy : public IStrategy
 {
+  std::shared_ptr<HashService> m_hash_service =
+      std::make_shared<HashService>();
+
+protected:
   std::map<uint32_t, std::vector<std::shared_ptr<Downloader>>>
       m_piece_downloaders;
   std::map<std::shared_ptr<Downloader>, std::vector<uint32_t>> m_peer_pool;
 
-  std::set<PeerContactInfo> m_active_connections;
   std::set<uint32_t> m_missing_pieces;
 
+  // Found in storage, neither missing nor verified until rechecked
+  std::vector<uint32_t> m_unchecked_pieces;
+
   std::shared_ptr<InternalContext> m_app_context;
+  PiecePicker m_picker;
+
+private:
+  ConnectionScheduler m_connection_scheduler;
+  PeerManager m_peer_manager;
+
+  // Disconnected, kept until their peer's loops stopped calling into them
+  std::vector<std::shared_ptr<Downloader>> m_retired_downloaders;
   std::shared_ptr<IStorage> m_storage_device;
+  std::shared_ptr<PiecePool> m_piece_pool;
+  std::shared_ptr<PartialPieces> m_partial_pieces;
+  std::shared_ptr<completion_channel> m_completions;
+
+  // Collected off the channel by a receive that's never cancelled, so no
+  // completion is lost to a wait that timed out. The signal is cancelled to
+  // wake `complete` up.
+  std::vector<uint32_t> m_completed_pieces;
+  std::optional<boost::asio::steady_timer> m_completion_signal;
+
+  // Advertised to every peer once connected
+  std::shared_ptr<aux::BitField> m_have_pieces;
+
+  // Sees each downloader's messages, to track which pieces its peer has
+  std::map<std::shared_ptr<Downloader>, std::shared_ptr<message_callback>>
+      m_peer_message_callbacks;
+
+  std::vector<PeerContactInfo> m_discovered_contacts;
+  std::shared_ptr<message_callback> m_peer_exchange_callback;
+  std::chrono::steady_clock::time_point m_last_peer_exchange {};
+
+  static constexpr auto PEER_EXCHANGE_INTERVAL = std::chrono::minutes(1);
+
+  // Stored pieces read and hashed together, one per multi-buffer lane
+  static constexpr size_t RECHECK_BATCH_PIECES = 8;
 
 public:
+  // Pieces in random order, however many peers have them
   RandomPieceStrategy(std::shared_ptr<InternalContext> app_context,
                       std::shared_ptr<IStorage> storage_device)
+      : RandomPieceStrategy {std::move(app_context),
+                             std::move(storage_device),
+                             PiecePickerPolicy {.rarest_first = false}}
+  {
+  }
+
+protected:
+  // For strategies ordering the pieces otherwise, e.g. rarest first
+  RandomPieceStrategy(std::shared_ptr<InternalContext> app_context,
+                      std::shared_ptr<IStorage> storage_device,
+                      PiecePickerPolicy picker_policy)
       : m_app_context {std::move(app_context)}
+      , m_picker {m_app_context->piece_count, picker_policy}
       , m_storage_device {std::move(storage_device)}
+      , m_piece_pool {std::make_shared<PiecePool>(m_app_context->piece_size)}
+      , m_partial_pieces {std::make_shared<PartialPieces>(
+            m_app_context, m_piece_pool, m_storage_device)}
+      , m_have_pieces {std::make_shared<aux::BitField>(
+            std::vector<uint8_t>((m_app_context->piece_count + 7) / 8))}
+      , m_peer_exchange_callback {std::make_shared<message_callback>(
+            [this](const TorrentMessage& message)
+                -> boost::asio::awaitable<void>
+            {
+              collect_exchanged_peers(message);
+              co_return;
+            })}
   {
+    // Downloads of the previous run are started over
+    m_storage_device->discard_parts(m_app_context->info_hash_as_string());
+
     for (uint32_t i = 0; i < m_app_context->piece_count; i++) {
       if (!m_storage_device->exists(m_app_context->info_hash_as_string(), i)) {
         m_missing_pieces.insert(i);
+      } else {
+        m_unchecked_pieces.push_back(i);
+      }
+    }
+  }
+
+public:
+  boost::asio::awaitable<void> recheck() override final
+  {
+    auto info_hash = m_app_context->info_hash_as_string();
+    auto unchecked = std::exchange(m_unchecked_pieces, {});
+
+    for (size_t first = 0; first < unchecked.size();
+         first += RECHECK_BATCH_PIECES)
+    {
+      auto batch = std::span {unchecked}.subspan(
+          first, std::min(RECHECK_BATCH_PIECES, unchecked.size() - first));
+
+      std::vector<std::vector<uint8_t>> buffers;
+      std::vector<bool> pulled;
+
+      for (auto index : batch) {
+        auto size = m_app_context->get_piece_size(index);
+        auto& buffer = buffers.emplace_back(m_piece_pool->acquire(size));
+
+        pulled.push_back(co_await m_storage_device->pull_piece(
+            info_hash, index, 0, size, buffer));
+      }
+
+      auto digests = co_await m_hash_service->hash_many(
+          {buffers.cbegin(), buffers.cend()});
+
+      for (size_t i = 0; i < batch.size(); i++) {
+        auto index = batch[i];
+        const auto& expected = m_app_context->piece_hashes[index];
+
+        if (pulled[i] && std::ranges::equal(digests[i], expected)) {
+          m_picker.mark_have(index);
+          m_have_pieces->mark(index, true);
+        } else {
+          // Storing a piece never overwrites, the corrupt copy must go first
+          m_storage_device->remove_piece(info_hash, index);
+          m_missing_pieces.insert(index);
+        }
+
+        m_piece_pool->release(std::move(buffers[i]));
       }
     }
   }
@@ -57,48 +189,169 @@ public:
   {
     auto io = co_await boost::asio::this_coro::executor;
 
+    completion_channel_on(io);
+
+    auto now = std::chrono::steady_clock::now();
+
     for (const auto& contact : potential_peers) {
-      if (!m_active_connections.contains(contact)) {
-        m_active_connections.insert(contact);
-        auto peer = std::make_shared<Peer>(m_app_context, contact, io);
-        auto downloader = std::make_shared<Downloader>(m_app_context, peer);
+      m_connection_scheduler.add(contact, now);
+    }
+
+    connect_candidates(io);
+  }
+
+  boost::asio::awaitable<void> assign() override final
+  {
+    if (!m_discovered_contacts.empty()) {
+      auto discovered = std::exchange(m_discovered_contacts, {});
+      co_await include(discovered);
+    }
+
+    // Connects that finished since left room for the next ones
+    connect_candidates(co_await boost::asio::this_coro::executor);
+
+    co_await assign_urgent();
+    co_await assign_preferred();
+
+    // Each peer with room picks its own next piece, so the work follows the
+    // pieces handed out rather than pieces times peers
+    for (auto& [downloader, assigned_pieces] : m_peer_pool) {
+      if (!downloader->is_snubbed()) {
+        co_await join_partial(downloader, assigned_pieces);
+      }
+
+      while (assigned_pieces.size() < MAX_PIECES_PER_PEER) {
+        // Snubbed peers only get pieces nobody else is fetching
+        auto piece_index = m_picker.pick(
+            downloader.get(), assigned_pieces, downloader->is_snubbed());
+
+        if (!piece_index || !co_await downloader->download_piece(*piece_index))
+        {
+          break;
+        }
+
+        attach(downloader, *piece_index);
+      }
+    }
+
+    if (in_endgame()) {
+      co_await assign_endgame();
+    }
+  }
 
-        m_peer_pool[downloader] = {};
+  // Started pieces with blocks left to request are finished before new ones
+  // are picked, so fewer pieces sit half done
+  boost::asio::awaitable<void> join_partial(
+      const std::shared_ptr<Downloader>& downloader,
+      const std::vector<uint32_t>& assigned_pieces)
+  {
+    for (auto piece_index : m_partial_pieces->unclaimed()) {
+      if (assigned_pieces.size() >= MAX_PIECES_PER_PEER) {
+        break;
+      }
+
+      if (std::ranges::contains(assigned_pieces, piece_index)) {
+        continue;
+      }
 
-        boost::asio::co_spawn(io, peer->start_async(), boost::asio::detached);
+      if (co_await downloader->download_piece(piece_index)) {
+        attach(downloader, piece_index);
       }
     }
   }
 
-  boost::asio::awaitable<void> assign() override final
+  // Every missing piece is being downloaded, and what's left of them could
+  // be requested at once given the peers' pipelines
+  bool in_endgame() const
+  {
+    size_t remaining_blocks = 0;
+    size_t request_budget = 0;
+
+    for (auto index : m_missing_pieces) {
+      auto downloaders = m_piece_downloaders.find(index);
+
+      if (downloaders == m_piece_downloaders.end()
+          || downloaders->second.empty())
+      {
+        return false;
+      }
+
+      size_t fewest = std::numeric_limits<size_t>::max();
+
+      for (const auto& downloader : downloaders->second) {
+        fewest = std::min(
+            fewest, downloader->missing_blocks(index).value_or(fewest));
+      }
+
+      remaining_blocks += fewest;
+    }
+
+    for (const auto& [downloader, _] : m_peer_pool) {
+      if (downloader->get_activity().is_active) {
+        request_budget += downloader->get_pipeline().depth();
+      }
+    }
+
+    return remaining_blocks <= request_budget;
+  }
+
+  // Every capable peer joins every remaining piece and may request blocks
+  // already requested elsewhere, the first copy of each block wins
+  boost::asio::awaitable<void> assign_endgame()
   {
     std::vector missing_pieces(m_missing_pieces.cbegin(),
-                                         m_missing_pieces.cend());
-    static std::random_device rd;
-    static std::mt19937 rand_generator(rd());
-
-    std::ranges::shuffle(missing_pieces.begin(), missing_pieces.end(), rand_generator);
-
-    for (size_t i = 0; i < 2; i++) {
-      for (auto piece_index : missing_pieces) {
-        if (m_piece_downloaders[piece_index].size() < 2) {
-          for (auto& [downloader, assigned_pieces] : m_peer_pool) {
-            if (std::ranges::contains(m_piece_downloaders[piece_index],
-                                      downloader))
-            {
-              continue;
-            }
-            if (downloader->get_context().status.remote_bitfield.get(
-                    piece_index)
-                && assigned_pieces.size() < 2)
-            {
-              if (co_await downloader->download_piece(piece_index)) {
-                assigned_pieces.push_back(piece_index);
-                m_piece_downloaders[piece_index].push_back(downloader);
-                break;
-              }
-            }
-          }
+                               m_missing_pieces.cend());
+
+    for (auto piece_index : missing_pieces) {
+      for (auto& [downloader, assigned_pieces] : m_peer_pool) {
+        auto& piece_downloaders = m_piece_downloaders[piece_index];
+
+        if (piece_downloaders.empty()
+            || !downloader->get_activity().is_active
+            || std::ranges::contains(piece_downloaders, downloader)
+            || !downloader->get_context().status.remote_bitfield.get(
+                piece_index))
+        {
+          continue;
+        }
+
+        if (co_await downloader->download_piece(piece_index, true)) {
+          attach(downloader, piece_index);
+        }
+      }
+    }
+  }
+
+  // Pieces a peer suggested, or lets us fetch while it chokes us (BEP 6)
+  boost::asio::awaitable<void> assign_preferred()
+  {
+    for (auto& [downloader, assigned_pieces] : m_peer_pool) {
+      const auto& status = downloader->get_context().status;
+
+      std::vector<uint32_t> preferred(status.suggested_pieces.cbegin(),
+                                      status.suggested_pieces.cend());
+
+      if (status.self_choked) {
+        preferred.insert(preferred.begin(),
+                         status.allowed_fast_pieces.cbegin(),
+                         status.allowed_fast_pieces.cend());
+      }
+
+      for (auto piece_index : preferred) {
+        if (assigned_pieces.size() >= MAX_PIECES_PER_PEER) {
+          break;
+        }
+
+        if (!m_missing_pieces.contains(piece_index)
+            || m_piece_downloaders[piece_index].size() >= 2
+            || std::ranges::contains(m_piece_downloaders[piece_index],
+                                     downloader))
+        {
+          continue;
+        }
+
+        if (co_await downloader->download_piece(piece_index)) {
+          attach(downloader, piece_index);
         }
       }
     }
@@ -108,66 +361,560 @@ public:
   {
     std::vector<std::shared_ptr<Downloader>> downloaders_to_remove {};
 
-    for (auto& [downloader, pieces] : m_peer_pool) {
+    for (auto& [downloader, _] : m_peer_pool) {
       if (!downloader->get_activity().is_active) {
-        for (auto piece : pieces) {
-          auto& piece_downloaders = m_piece_downloaders[piece];
+        downloaders_to_remove.push_back(downloader);
+      }
+    }
+
+    for (auto& downloader : downloaders_to_remove) {
+      remove_downloader(downloader);
+    }
 
-          piece_downloaders.erase(std::remove(piece_downloaders.begin(),
-                                              piece_downloaders.end(),
-                                              downloader),
-                                  piece_downloaders.end());
+    std::erase_if(m_retired_downloaders,
+                  [](const std::shared_ptr<Downloader>& downloader)
+                  { return !downloader->get_activity().is_active; });
 
-          downloaders_to_remove.push_back(downloader);
+    co_await reassign_stalled();
+
+    turn_over_peers();
+    connect_candidates(co_await boost::asio::this_coro::executor);
+
+    exchange_peers();
+  }
+
+  // Pieces of a peer that stopped answering requests move to one that is
+  // still delivering, the blocks received so far stay with the piece
+  boost::asio::awaitable<void> reassign_stalled()
+  {
+    for (const auto& [downloader, _] : m_peer_pool) {
+      if (downloader->get_activity().is_active) {
+        co_await downloader->expire_requests();
+      }
+    }
+
+    for (auto& [stalled, assigned_pieces] : m_peer_pool) {
+      if (!stalled->is_snubbed()) {
+        continue;
+      }
+
+      auto stalled_pieces = assigned_pieces;
+
+      for (auto piece_index : stalled_pieces) {
+        auto& piece_downloaders = m_piece_downloaders[piece_index];
+
+        bool covered = std::ranges::any_of(
+            piece_downloaders,
+            [&stalled](const std::shared_ptr<Downloader>& other)
+            { return other != stalled && !other->is_snubbed(); });
+
+        if (!covered) {
+          auto replacement = std::ranges::find_if(
+              m_peer_pool,
+              [&](const auto& candidate)
+              {
+                const auto& [downloader, pieces] = candidate;
+
+                return downloader->get_activity().is_active
+                    && !downloader->is_snubbed()
+                    && pieces.size() < MAX_PIECES_PER_PEER
+                    && !std::ranges::contains(piece_downloaders, downloader)
+                    && downloader->get_context().status.remote_bitfield.get(
+                        piece_index);
+              });
+
+          // Left to the stalled peer until someone is free to take over
+          if (replacement == m_peer_pool.end()
+              || !co_await replacement->first->download_piece(piece_index))
+          {
+            continue;
+          }
+
+          attach(replacement->first, piece_index);
         }
+
+        stalled->cancel_piece(piece_index);
+        detach(stalled, piece_index);
       }
     }
+  }
 
-    for (auto& downloader : downloaders_to_remove) {
-      m_peer_pool.erase(downloader);
-      m_active_connections.erase(downloader->get_context().contact_info);
+  void collect_exchanged_peers(const TorrentMessage& message)
+  {
+    const auto* extended = std::get_if<Extended>(&message);
+
+    if (extended && extended->get_metadata().extended_id == LOCAL_UT_PEX_ID) {
+      std::ranges::copy(parse_peer_exchange(extended->get_payload()),
+                        std::back_inserter(m_discovered_contacts));
+    }
+  }
+
+  // Tells every ut_pex capable peer how the rest of our swarm changed since
+  // its last exchange (BEP 11)
+  void exchange_peers()
+  {
+    auto now = std::chrono::steady_clock::now();
+
+    if (now - m_last_peer_exchange < PEER_EXCHANGE_INTERVAL) {
+      return;
     }
 
-    co_return;
+    m_last_peer_exchange = now;
+
+    std::vector<PeerContactInfo> connected;
+
+    for (const auto& [downloader, _] : m_peer_pool) {
+      if (downloader->get_activity().is_active) {
+        connected.push_back(downloader->get_context().contact_info);
+      }
+    }
+
+    for (const auto& [downloader, _] : m_peer_pool) {
+      if (!downloader->get_activity().is_active) {
+        continue;
+      }
+
+      std::vector<PeerContactInfo> others;
+      std::ranges::copy_if(connected,
+                           std::back_inserter(others),
+                           [&](const PeerContactInfo& contact)
+                           {
+                             return !(contact
+                                      == downloader->get_context().contact_info);
+                           });
+
+      downloader->exchange_peers(others);
+    }
+  }
+
+  boost::asio::awaitable<void> complete(
+      std::chrono::steady_clock::duration timeout) override final
+  {
+    completion_channel_on(co_await boost::asio::this_coro::executor);
+
+    if (m_completed_pieces.empty()) {
+      boost::system::error_code woken;
+
+      m_completion_signal->expires_after(timeout);
+      co_await m_completion_signal->async_wait(
+          boost::asio::redirect_error(boost::asio::use_awaitable, woken));
+    }
+
+    for (auto index : std::exchange(m_completed_pieces, {})) {
+      co_await complete_piece(index);
+    }
   }
 
   boost::asio::awaitable<bool> is_done() override final
   {
-    std::vector<uint32_t> completed_indexes {};
+    co_return m_missing_pieces.empty() && m_unchecked_pieces.empty();
+  }
 
-    for (auto& [index, downloaders] : m_piece_downloaders) {
-      for (auto downloader : downloaders) {
-        if (auto piece = co_await downloader->retrieve_piece(index)) {
-          switch (piece->status) {
-            case PieceStatus::Complete:
-              co_await m_storage_device->push_piece(
-                  m_app_context->info_hash_as_string(), index, piece->data);
+protected:
+  // Pieces a peer downloads at once
+  static constexpr size_t MAX_PIECES_PER_PEER = 2;
 
-              m_peer_pool[downloader].erase(
-                  std::remove(m_peer_pool[downloader].begin(),
-                              m_peer_pool[downloader].end(),
-                              index));
-              completed_indexes.push_back(index);
+  void attach(const std::shared_ptr<Downloader>& downloader, uint32_t index)
+  {
+    m_peer_pool[downloader].push_back(index);
+    m_piece_downloaders[index].push_back(downloader);
+    m_picker.add_downloader(index);
+  }
 
-              m_missing_pieces.erase(index);
-              break;
+  void detach(const std::shared_ptr<Downloader>& downloader, uint32_t index)
+  {
+    std::erase(m_peer_pool[downloader], index);
+    std::erase(m_piece_downloaders[index], downloader);
+    m_picker.remove_downloader(index);
+  }
 
-            case PieceStatus::Corrupt:
-              co_await downloader->download_piece(index);
-              break;
+  // Bytes of a piece being downloaded that weren't received yet
+  uint64_t missing_bytes(uint32_t index) const
+  {
+    auto shared = m_partial_pieces->find(index);
 
-            default:
-              break;
-          }
-        }
+    return shared ? shared->missing_bytes() : 0;
+  }
+
+  // Runs before anything else is assigned, for pieces that can't wait
+  virtual boost::asio::awaitable<void> assign_urgent() { co_return; }
+
+private:
+  // Connects waiting candidates while the connection limits allow
+  void connect_candidates(const boost::asio::any_io_executor& io)
+  {
+    while (m_peer_manager.has_room()) {
+      auto contact =
+          m_connection_scheduler.next(std::chrono::steady_clock::now());
+
+      if (!contact) {
+        break;
+      }
+
+      auto peer = std::make_shared<Peer>(m_app_context, *contact, io);
+      auto downloader = std::make_shared<Downloader>(m_app_context,
+                                                     peer,
+                                                     m_hash_service,
+                                                     m_partial_pieces,
+                                                     m_completions,
+                                                     m_storage_device);
+
+      peer->set_have_pieces(m_have_pieces);
+      peer->add_callback(m_peer_exchange_callback);
+
+      auto peer_messages = std::make_shared<message_callback>(
+          [this, source = std::weak_ptr {downloader}](
+              const TorrentMessage& message) -> boost::asio::awaitable<void>
+          {
+            if (auto downloader = source.lock()) {
+              track_pieces(downloader, message);
+            }
+
+            co_return;
+          });
+
+      peer->add_callback(peer_messages);
+      m_peer_message_callbacks[downloader] = std::move(peer_messages);
+
+      m_peer_pool[downloader] = {};
+      m_picker.add_peer(downloader.get());
+      m_peer_manager.connected(downloader.get(),
+                               std::chrono::steady_clock::now());
+
+      // Owned by its loops, it may be dropped here before they exited
+      boost::asio::co_spawn(
+          io,
+          [this, peer, contact = *contact]() -> boost::asio::awaitable<void>
+          {
+            bool connected = false;
+
+            co_await peer->start_async(
+                [&]
+                {
+                  connected = true;
+                  m_connection_scheduler.on_connected(contact);
+                });
+
+            auto now = std::chrono::steady_clock::now();
+
+            if (connected) {
+              m_connection_scheduler.on_closed(contact, now);
+            } else {
+              m_connection_scheduler.on_failed(contact, now);
+            }
+          },
+          boost::asio::detached);
+    }
+  }
+
+  void remove_downloader(const std::shared_ptr<Downloader>& downloader)
+  {
+    for (auto piece : m_peer_pool[downloader]) {
+      // Its requested blocks are free for the others right away
+      downloader->cancel_piece(piece);
+      std::erase(m_piece_downloaders[piece], downloader);
+      m_picker.remove_downloader(piece);
+    }
+
+    m_picker.remove_peer(downloader.get());
+    m_peer_manager.disconnected(downloader.get());
+
+    m_peer_pool.erase(downloader);
+    m_peer_message_callbacks.erase(downloader);
+  }
+
+  // Disconnects the slowest peers, so the waiting candidates can replace them
+  void turn_over_peers()
+  {
+    auto now = std::chrono::steady_clock::now();
+
+    for (const auto& [downloader, _] : m_peer_pool) {
+      m_peer_manager.record(
+          downloader.get(), downloader->get_activity().bytes_received, now);
+    }
+
+    auto slowest =
+        m_peer_manager.select_turnover(m_connection_scheduler.waiting(), now);
+
+    for (auto slow : slowest) {
+      auto entry = std::ranges::find_if(
+          m_peer_pool,
+          [slow](const auto& candidate)
+          { return candidate.first.get() == slow; });
+
+      if (entry == m_peer_pool.end()) {
+        continue;
+      }
+
+      auto downloader = entry->first;
+
+      remove_downloader(downloader);
+      m_connection_scheduler.give_up(downloader->get_context().contact_info);
+
+      downloader->disconnect();
+      m_retired_downloaders.push_back(std::move(downloader));
+    }
+  }
+
+  // Availability follows the peers' announcements as they arrive
+  void track_pieces(const std::shared_ptr<Downloader>& downloader,
+                    const TorrentMessage& message)
+  {
+    const auto& announced = downloader->get_context().status.remote_bitfield;
+
+    std::visit(
+        overloaded {[](const auto&) {},
+                    [&](const Have& have)
+                    { m_picker.peer_has(downloader.get(), have.piece_index); },
+                    [&](const BitField&)
+                    { m_picker.set_peer_pieces(downloader.get(), announced); },
+                    [&](const HaveAll&)
+                    { m_picker.set_peer_pieces(downloader.get(), announced); },
+                    [&](const HaveNone&)
+                    { m_picker.set_peer_pieces(downloader.get(), announced); }},
+        message);
+  }
+
+  // Sized so a downloader never waits to announce a piece
+  completion_channel& completion_channel_on(
+      const boost::asio::any_io_executor& io)
+  {
+    if (!m_completions) {
+      m_completions = std::make_shared<completion_channel>(
+          io, m_app_context->piece_count);
+      m_completion_signal.emplace(io);
+
+      boost::asio::co_spawn(io, collect_completions(), boost::asio::detached);
+    }
+
+    return *m_completions;
+  }
+
+  boost::asio::awaitable<void> collect_completions()
+  {
+    auto completions = m_completions;
+
+    while (true) {
+      auto index =
+          co_await completions->async_receive(boost::asio::use_awaitable);
+
+      m_completed_pieces.push_back(index);
+      m_completion_signal->cancel();
+    }
+  }
+
+  // Stores a piece that finished downloading, or starts it over if it
+  // turned out corrupt
+  boost::asio::awaitable<void> complete_piece(uint32_t index)
+  {
+    auto piece = m_partial_pieces->retrieve(index);
+
+    if (!piece) {
+      co_return;
+    }
+
+    auto downloaders = m_piece_downloaders[index];
+
+    if (piece->status == PieceStatus::Corrupt) {
+      m_piece_pool->release(std::move(piece->data));
+
+      for (const auto& downloader : downloaders) {
+        co_await downloader->download_piece(index);
       }
+
+      co_return;
     }
 
-    for (auto index : completed_indexes) {
-      m_piece_downloaders.erase(index);
+    if (!piece->stored) {
+      co_await m_storage_device->push_piece(
+          m_app_context->info_hash_as_string(), index, piece->data);
+    }
+
+    m_piece_pool->release(std::move(piece->data));
+
+    m_missing_pieces.erase(index);
+    m_picker.mark_have(index);
+    m_have_pieces->mark(index, true);
+
+    // Requests still out for the piece are spared the upload
+    for (const auto& downloader : downloaders) {
+      downloader->cancel_piece(index);
+      std::erase(m_peer_pool[downloader], index);
+    }
+
+    m_piece_downloaders.erase(index);
+  }
+};
+
+/*
+ * Hands out the pieces fewest peers have first, so scarce pieces are copied
+ * before their holders leave.
+ */
+class RarestFirstStrategy : public RandomPieceStrategy
+{
+public:
+  RarestFirstStrategy(std::shared_ptr<InternalContext> app_context,
+                      std::shared_ptr<IStorage> storage_device)
+      : RandomPieceStrategy {std::move(app_context),
+                             std::move(storage_device),
+                             PiecePickerPolicy {.rarest_first = true}}
+  {
+  }
+};
+
+struct StreamingPolicy
+{
+  // Pieces ahead of the playback cursor that get deadlines
+  uint32_t deadline_window_pieces = 16;
+
+  // Downloaders racing for a piece whose deadline is at risk
+  size_t max_urgent_downloaders = 3;
+};
+
+/*
+ * Downloads a file so it can be consumed while it downloads. Pieces with a
+ * deadline go first, earliest deadline first, each to the fastest peer that
+ * has it and room for another piece. When a piece's downloaders can't make
+ * its deadline at their current rate, the next fastest peer joins it with
+ * the blocks received so far. Everything else is filled in rarest first.
+ */
+class StreamingStrategy : public RarestFirstStrategy
+{
+  StreamingPolicy m_policy;
+
+  std::map<uint32_t, std::chrono::steady_clock::time_point> m_deadlines;
+  uint64_t m_playback_cursor = 0;
+
+  // Background picks also favour pieces that have a deadline
+  static constexpr uint8_t DEADLINE_PRIORITY = 1;
+
+public:
+  StreamingStrategy(std::shared_ptr<InternalContext> app_context,
+                    std::shared_ptr<IStorage> storage_device,
+                    StreamingPolicy policy = {})
+      : RarestFirstStrategy {std::move(app_context), std::move(storage_device)}
+      , m_policy {policy}
+  {
+  }
+
+  void set_deadline(uint32_t index, std::chrono::steady_clock::time_point at)
+  {
+    m_deadlines[index] = at;
+    m_picker.set_priority(index, DEADLINE_PRIORITY);
+  }
+
+  void clear_deadline(uint32_t index)
+  {
+    m_deadlines.erase(index);
+    m_picker.set_priority(index, 0);
+  }
+
+  // Playback is at `offset` and consumes `bytes_per_second`, the pieces of
+  // the window ahead are due by the time playback reaches them. A paused
+  // playback's rate is 0.
+  void set_playback_cursor(uint64_t offset, double bytes_per_second)
+  {
+    auto piece_size = m_app_context->piece_size;
+    auto first = static_cast<uint32_t>(offset / piece_size);
+    auto end = std::min<uint64_t>(
+        uint64_t {first} + m_policy.deadline_window_pieces,
+        m_app_context->piece_count);
+    auto now = std::chrono::steady_clock::now();
+
+    m_playback_cursor = offset;
+
+    // Pieces behind the cursor were consumed or skipped over
+    while (!m_deadlines.empty() && m_deadlines.begin()->first < first) {
+      clear_deadline(m_deadlines.begin()->first);
+    }
+
+    for (auto index = first; index < end; index++) {
+      auto ahead = uint64_t {index} * piece_size > offset
+          ? uint64_t {index} * piece_size - offset
+          : 0;
+
+      set_deadline(index, playback_deadline(now, ahead, bytes_per_second));
+    }
+  }
+
+  // Bytes from the playback cursor on that can be read from storage
+  uint64_t playable_bytes() const
+  {
+    return btr::playable_bytes(
+        *m_app_context, m_playback_cursor, m_missing_pieces);
+  }
+
+protected:
+  boost::asio::awaitable<void> assign_urgent() override final
+  {
+    auto now = std::chrono::steady_clock::now();
+
+    for (auto index : earliest_deadlines(m_deadlines, m_missing_pieces)) {
+      auto& piece_downloaders = m_piece_downloaders[index];
+
+      if (!piece_downloaders.empty()
+          && (piece_downloaders.size() >= m_policy.max_urgent_downloaders
+              || !at_risk(index, m_deadlines[index], now)))
+      {
+        continue;
+      }
+
+      auto fastest = fastest_peer(index);
+
+      if (!fastest) {
+        continue;
+      }
+
+      // Racing the downloaders for an at risk piece means re-requesting the
+      // blocks they were asked for
+      bool duplicate = !piece_downloaders.empty();
+
+      if (co_await fastest->download_piece(index, duplicate)) {
+        attach(fastest, index);
+      }
+    }
+  }
+
+private:
+  // The fastest delivering peer that has the piece, isn't fetching it and
+  // has room for another piece
+  std::shared_ptr<Downloader> fastest_peer(uint32_t index) const
+  {
+    std::shared_ptr<Downloader> fastest;
+    const auto& piece_downloaders = m_piece_downloaders.at(index);
+
+    for (const auto& [downloader, assigned_pieces] : m_peer_pool) {
+      if (!downloader->get_activity().is_active || downloader->is_snubbed()
+          || assigned_pieces.size() >= MAX_PIECES_PER_PEER
+          || std::ranges::contains(piece_downloaders, downloader)
+          || !downloader->get_context().status.remote_bitfield.get(index))
+      {
+        continue;
+      }
+
+      if (!fastest
+          || downloader->get_pipeline().delivery_rate()
+              > fastest->get_pipeline().delivery_rate())
+      {
+        fastest = downloader;
+      }
+    }
+
+    return fastest;
+  }
+
+  // Whether the piece's downloaders, at their combined rate, finish it late
+  bool at_risk(uint32_t index,
+               std::chrono::steady_clock::time_point deadline,
+               std::chrono::steady_clock::time_point now) const
+  {
+    double rate = 0;
+
+    for (const auto& downloader : m_piece_downloaders.at(index)) {
+      rate += downloader->get_pipeline().delivery_rate();
     }
 
-    co_return m_missing_pieces.empty();
+    return deadline_at_risk(missing_bytes(index), rate, deadline, now);
   }
 };
-}  // namespace btr
\ No newline at end of file
+}  // namespace btr
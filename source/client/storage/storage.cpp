@@ -1,3 +1,4 @@
+#include <format>
 #include <print>
 
 #include "storage.hpp"
@@ -64,3 +65,183 @@ bool FileDirectoryStorage::exists(std::string_view info_hash, size_t index)
   return std::filesystem::exists(path);
 }
 
+void FileDirectoryStorage::remove_piece(std::string_view info_hash,
+                                        size_t index)
+{
+  std::error_code ignored;
+  std::filesystem::remove(m_vault / info_hash / std::to_string(index),
+                          ignored);
+}
+
+boost::asio::awaitable<void> FileDirectoryStorage::push_block(
+    std::string_view info_hash,
+    size_t index,
+    uint64_t part,
+    size_t offset,
+    std::span<const uint8_t> data)
+{
+  auto path = part_path(info_hash, index, part);
+  auto file = start_io(co_await boost::asio::this_coro::executor, path);
+
+  // A part being committed or discarded isn't written anymore
+  if (!file) {
+    co_return;
+  }
+
+  try {
+    co_await boost::asio::async_write_at(*file,
+                                         offset,
+                                         boost::asio::buffer(data.data(),
+                                                             data.size()),
+                                         boost::asio::use_awaitable);
+  } catch (...) {
+    finish_io(path);
+    throw;
+  }
+
+  finish_io(path);
+}
+
+boost::asio::awaitable<bool> FileDirectoryStorage::pull_block(
+    std::string_view info_hash,
+    size_t index,
+    uint64_t part,
+    size_t offset,
+    std::span<uint8_t> buffer)
+{
+  auto path = part_path(info_hash, index, part);
+
+  if (!m_open_parts.contains(path) && !std::filesystem::exists(path)) {
+    co_return false;
+  }
+
+  auto file = start_io(co_await boost::asio::this_coro::executor, path);
+
+  if (!file) {
+    co_return false;
+  }
+
+  try {
+    co_await boost::asio::async_read_at(*file,
+                                        offset,
+                                        boost::asio::buffer(buffer.data(),
+                                                            buffer.size()),
+                                        boost::asio::use_awaitable);
+  } catch (...) {
+    finish_io(path);
+    throw;
+  }
+
+  finish_io(path);
+
+  co_return true;
+}
+
+void FileDirectoryStorage::commit_piece(std::string_view info_hash,
+                                        size_t index,
+                                        uint64_t part)
+{
+  close_part(part_path(info_hash, index, part),
+             m_vault / info_hash / std::to_string(index));
+}
+
+void FileDirectoryStorage::discard_piece(std::string_view info_hash,
+                                         size_t index,
+                                         uint64_t part)
+{
+  close_part(part_path(info_hash, index, part), std::nullopt);
+}
+
+void FileDirectoryStorage::discard_parts(std::string_view info_hash)
+{
+  std::error_code ignored;
+
+  for (const auto& entry :
+       std::filesystem::directory_iterator {m_vault / info_hash, ignored})
+  {
+    if (entry.path().extension() == ".part"
+        && !m_open_parts.contains(entry.path()))
+    {
+      std::filesystem::remove(entry.path(), ignored);
+    }
+  }
+}
+
+std::shared_ptr<boost::asio::random_access_file> FileDirectoryStorage::start_io(
+    const boost::asio::any_io_executor& io, const std::filesystem::path& path)
+{
+  auto& open = m_open_parts[path];
+
+  if (open.closing) {
+    return nullptr;
+  }
+
+  if (!open.file) {
+    if (!std::filesystem::exists(path.parent_path())) {
+      std::filesystem::create_directories(path.parent_path());
+    }
+
+    try {
+      open.file = std::make_shared<boost::asio::random_access_file>(
+          io,
+          path.string(),
+          boost::asio::random_access_file::flags::read_write
+              | boost::asio::random_access_file::flags::create);
+    } catch (...) {
+      m_open_parts.erase(path);
+      throw;
+    }
+  }
+
+  open.pending_io++;
+
+  return open.file;
+}
+
+void FileDirectoryStorage::finish_io(const std::filesystem::path& path)
+{
+  auto open = m_open_parts.find(path);
+
+  if (open == m_open_parts.end()) {
+    return;
+  }
+
+  open->second.pending_io--;
+
+  if (open->second.closing && open->second.pending_io == 0) {
+    close_part(path, open->second.commit_to);
+  }
+}
+
+void FileDirectoryStorage::close_part(
+    const std::filesystem::path& path,
+    std::optional<std::filesystem::path> piece)
+{
+  auto open = m_open_parts.find(path);
+
+  // The file stays open as long as blocks are in flight on it
+  if (open != m_open_parts.end() && open->second.pending_io > 0) {
+    open->second.closing = true;
+    open->second.commit_to = std::move(piece);
+    return;
+  }
+
+  if (open != m_open_parts.end()) {
+    m_open_parts.erase(open);
+  }
+
+  // Another download of the piece may have been committed first
+  if (piece && !std::filesystem::exists(*piece)) {
+    std::filesystem::rename(path, *piece);
+    return;
+  }
+
+  std::error_code ignored;
+  std::filesystem::remove(path, ignored);
+}
+
+std::filesystem::path FileDirectoryStorage::part_path(
+    std::string_view info_hash, size_t index, uint64_t part) const
+{
+  return m_vault / info_hash / std::format("{}.{}.part", index, part);
+}
@@ -1,9 +1,14 @@
 #pragma once
 
 #include <filesystem>
+#include <map>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string_view>
 
 #include <boost/asio.hpp>
+#include <boost/asio/random_access_file.hpp>
 
 class IStorage
 {
@@ -23,6 +28,37 @@ public:
 
   bool virtual exists(std::string_view info_hash, size_t index) = 0;
 
+  // Drops a stored piece, e.g. one that failed its recheck, so the next copy
+  // pushed or committed replaces it
+  void virtual remove_piece(std::string_view info_hash, size_t index) = 0;
+
+  // A piece may be written block by block while it downloads. Each download
+  // of it writes its own part, which only becomes the piece once committed.
+  boost::asio::awaitable<void> virtual push_block(
+      std::string_view info_hash,
+      size_t index,
+      uint64_t part,
+      size_t offset,
+      std::span<const uint8_t> data) = 0;
+
+  boost::asio::awaitable<bool> virtual pull_block(std::string_view info_hash,
+                                                  size_t index,
+                                                  uint64_t part,
+                                                  size_t offset,
+                                                  std::span<uint8_t> buffer) = 0;
+
+  void virtual commit_piece(std::string_view info_hash,
+                            size_t index,
+                            uint64_t part) = 0;
+
+  void virtual discard_piece(std::string_view info_hash,
+                             size_t index,
+                             uint64_t part) = 0;
+
+  // Parts are numbered anew on every start, so those a previous run left
+  // behind are dropped before downloading
+  void virtual discard_parts(std::string_view info_hash) = 0;
+
   virtual ~IStorage() = default;
 };
 
@@ -30,6 +66,23 @@ class FileDirectoryStorage : public IStorage
 {
   std::filesystem::path m_vault;
 
+  struct OpenPart
+  {
+    std::shared_ptr<boost::asio::random_access_file> file;
+
+    // Blocks being written or read right now
+    size_t pending_io = 0;
+
+    // Committed or discarded while blocks were in flight, settled once
+    // they're done
+    bool closing = false;
+    std::optional<std::filesystem::path> commit_to;
+  };
+
+  // A part stays open from its first block until it's committed or
+  // discarded, rather than being reopened for every block
+  std::map<std::filesystem::path, OpenPart> m_open_parts;
+
 public:
   FileDirectoryStorage(std::filesystem::path vault);
 
@@ -47,4 +100,47 @@ public:
       std::vector<uint8_t>& buffer) override final;
 
   bool exists(std::string_view info_hash, size_t index) override final;
+
+  void remove_piece(std::string_view info_hash,
+                    size_t index) override final;
+
+  boost::asio::awaitable<void> push_block(
+      std::string_view info_hash,
+      size_t index,
+      uint64_t part,
+      size_t offset,
+      std::span<const uint8_t> data) override final;
+
+  boost::asio::awaitable<bool> pull_block(std::string_view info_hash,
+                                          size_t index,
+                                          uint64_t part,
+                                          size_t offset,
+                                          std::span<uint8_t> buffer) override final;
+
+  void commit_piece(std::string_view info_hash,
+                    size_t index,
+                    uint64_t part) override final;
+
+  void discard_piece(std::string_view info_hash,
+                     size_t index,
+                     uint64_t part) override final;
+
+  void discard_parts(std::string_view info_hash) override final;
+
+private:
+  std::filesystem::path part_path(std::string_view info_hash,
+                                  size_t index,
+                                  uint64_t part) const;
+
+  // The part's file with an I/O counted against it, none once it's closing
+  std::shared_ptr<boost::asio::random_access_file> start_io(
+      const boost::asio::any_io_executor& io,
+      const std::filesystem::path& path);
+
+  void finish_io(const std::filesystem::path& path);
+
+  // Commits the part to `piece`, or discards it without one, once nothing
+  // is in flight on it anymore
+  void close_part(const std::filesystem::path& path,
+                  std::optional<std::filesystem::path> piece);
 };
\ No newline at end of file
@@ -0,0 +1,70 @@
+#include <algorithm>
+
+#include "client/transmit/receive_buffer.hpp"
+
+namespace btr
+{
+ReceiveBuffer::ReceiveBuffer(size_t initial_capacity)
+    : m_storage(initial_capacity)
+{
+  ++m_allocations;
+}
+
+std::span<uint8_t> ReceiveBuffer::prepare(size_t size)
+{
+  if (m_storage.size() - m_end >= size) {
+    return {m_storage.data() + m_end, size};
+  }
+
+  if (m_begin > 0) {
+    std::copy(m_storage.begin() + static_cast<std::ptrdiff_t>(m_begin),
+              m_storage.begin() + static_cast<std::ptrdiff_t>(m_end),
+              m_storage.begin());
+    m_end -= m_begin;
+    m_begin = 0;
+  }
+
+  if (m_storage.size() - m_end < size) {
+    m_storage.resize(std::max(m_storage.size() * 2, m_end + size));
+    ++m_allocations;
+  }
+
+  return {m_storage.data() + m_end, size};
+}
+
+void ReceiveBuffer::commit(size_t size)
+{
+  m_end += size;
+  m_bytes_received += size;
+}
+
+void ReceiveBuffer::consume(size_t size)
+{
+  m_begin += std::min(size, m_end - m_begin);
+
+  if (m_begin == m_end) {
+    m_begin = 0;
+    m_end = 0;
+  }
+}
+
+std::span<const uint8_t> ReceiveBuffer::data() const
+{
+  return {m_storage.data() + m_begin, m_end - m_begin};
+}
+
+size_t ReceiveBuffer::size() const
+{
+  return m_end - m_begin;
+}
+
+uint64_t ReceiveBuffer::allocations() const
+{
+  return m_allocations;
+}
+
+uint64_t ReceiveBuffer::bytes_received() const
+{
+  return m_bytes_received;
+}
+}  // namespace btr
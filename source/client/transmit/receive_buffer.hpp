@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace btr
+{
+/*
+ * Reusable per-peer receive storage.
+ * Bytes are appended at the back and consumed from the front. Consumed space
+ * is reclaimed by sliding the unread tail back to the front, so a message is
+ * always contiguous and can be parsed in place. Once the buffer reached its
+ * working size, receiving does not allocate anymore.
+ */
+class ReceiveBuffer
+{
+  std::vector<uint8_t> m_storage;
+  size_t m_begin = 0;
+  size_t m_end = 0;
+
+  uint64_t m_allocations = 0;
+  uint64_t m_bytes_received = 0;
+
+public:
+  ReceiveBuffer(size_t initial_capacity);
+
+  // Writable space for at least `size` bytes, invalidates views into data()
+  std::span<uint8_t> prepare(size_t size);
+
+  void commit(size_t size);
+
+  void consume(size_t size);
+
+  std::span<const uint8_t> data() const;
+
+  size_t size() const;
+
+  uint64_t allocations() const;
+
+  uint64_t bytes_received() const;
+};
+}  // namespace btr
@@ -1,5 +1,10 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
 #include <expected>
 #include <iostream>
+#include <iterator>
+#include <optional>
 #include <utility>
 
 #include "client/transmit/transmit.hpp"
@@ -8,110 +13,97 @@ namespace btr
 {
 namespace
 {
-template<uint32_t AnyLength, uint8_t AnyId>
-awaitable<void> send_message(tcp::socket& socket,
-                             MessageMetadata<AnyLength, AnyId>& message)
+using message_buffers_t = std::array<boost::asio::const_buffer, 2>;
+
+template<typename PackedStruct>
+message_buffers_t message_buffers(const PackedStruct& message)
 {
-  co_await boost::asio::async_write(
-      socket,
-      boost::asio::buffer(&message, sizeof(message)),
-      boost::asio::use_awaitable);
+  return {boost::asio::buffer(&message, sizeof(message)),
+          boost::asio::const_buffer {}};
 }
-template<typename PackedStruct>
-awaitable<void> send_message(tcp::socket& socket, PackedStruct& message)
+
+template<SupportsDynamicLength Metadata>
+message_buffers_t message_buffers(
+    const DynamicLengthMessage<Metadata>& message)
 {
-  co_await boost::asio::async_write(
-      socket,
-      boost::asio::buffer(&message, sizeof(message)),
-      boost::asio::use_awaitable);
+  auto payload = message.get_payload();
+
+  return {boost::asio::buffer(&message.get_metadata(), sizeof(Metadata)),
+          boost::asio::buffer(payload.data(), payload.size())};
 }
 
-awaitable<void> send_message(tcp::socket& socket, Keepalive& message)
+message_buffers_t buffers_of(const TorrentMessage& message)
 {
-  co_await boost::asio::async_write(
-      socket,
-      boost::asio::buffer(&message, sizeof(message)),
-      boost::asio::use_awaitable);
+  return std::visit([](const auto& value) { return message_buffers(value); },
+                    message);
 }
+}  // namespace
 
-template<SupportsDynamicLength Metadata>
 awaitable<void> send_message(tcp::socket& socket,
-                             DynamicLengthMessage<Metadata>& message)
+                             const TorrentMessage& message)
 {
-  auto metadata = message.get_metadata();
-
-  std::array<boost::asio::const_buffer, 2> buffers = {
-      boost::asio::buffer(&metadata, sizeof(metadata)),
-      boost::asio::buffer(message.get_payload())};
-
   co_await boost::asio::async_write(
-      socket, buffers, boost::asio::use_awaitable);
+      socket, buffers_of(message), boost::asio::use_awaitable);
 }
-}  // namespace
 
-awaitable<void> send_message(tcp::socket& socket, TorrentMessage& message)
+void SendBatch::push(TorrentMessage message)
 {
-  switch (message.index() - 1) {
-    case ID_KEEPALIVE:
-      co_await send_message(socket, std::get<Keepalive>(message));
-      break;
-
-    case ID_CHOKE:
-      co_await send_message(socket, std::get<Choke>(message));
-      break;
-
-    case ID_UNCHOKE:
-      co_await send_message(socket, std::get<Unchoke>(message));
-      break;
-
-    case ID_INTERESTED:
-      co_await send_message(socket, std::get<Interested>(message));
-      break;
+  m_bytes += boost::asio::buffer_size(buffers_of(message));
+  m_messages.push_back(std::move(message));
+}
 
-    case ID_NOT_INTERESTED:
-      co_await send_message(socket, std::get<NotInterested>(message));
-      break;
+void SendBatch::clear()
+{
+  m_messages.clear();
+  m_bytes = 0;
+}
 
-    case ID_HAVE:
-      co_await send_message(socket, std::get<Have>(message));
-      break;
+bool SendBatch::empty() const
+{
+  return m_messages.empty();
+}
 
-    case ID_BITFIELD:
-      co_await send_message(socket, std::get<BitField>(message));
-      break;
+size_t SendBatch::bytes() const
+{
+  return m_bytes;
+}
 
-    case ID_REQUEST:
-      co_await send_message(socket, std::get<Request>(message));
-      break;
+const std::vector<boost::asio::const_buffer>& SendBatch::buffers()
+{
+  m_buffers.clear();
 
-    case ID_PIECE:
-      co_await send_message(socket, std::get<Piece>(message));
-      break;
+  for (const auto& message : m_messages) {
+    for (const auto& buffer : buffers_of(message)) {
+      if (buffer.size() > 0) {
+        m_buffers.push_back(buffer);
+      }
+    }
+  }
 
-    case ID_PORT:
-      co_await send_message(socket, std::get<Port>(message));
-      break;
+  return m_buffers;
+}
 
-    case ID_CANCEL:
-      co_await send_message(socket, std::get<Cancel>(message));
-      break;
-  }
+awaitable<void> send_messages(tcp::socket& socket, SendBatch& batch)
+{
+  co_await boost::asio::async_write(
+      socket, batch.buffers(), boost::asio::use_awaitable);
 }
 
 namespace
 {
 template<typename T>
-std::expected<T*, ParseError> reinterpret_safely(std::vector<uint8_t>& buffer)
+std::expected<const T*, ParseError> reinterpret_safely(
+    std::span<const uint8_t> buffer)
 {
   if (sizeof(T) > buffer.size()) {
     return std::unexpected(ParseError::LengthMismatch);
   }
 
-  return reinterpret_cast<T*>(buffer.data());
+  return reinterpret_cast<const T*>(buffer.data());
 }
 
 std::expected<TorrentMessage, ParseError> parse_message(
-    uint8_t id, std::vector<uint8_t>& data)
+    uint8_t id, std::span<const uint8_t> data)
 {
   switch (id) {
     case ID_CHOKE:
@@ -127,22 +119,14 @@ std::expected<TorrentMessage, ParseError> parse_message(
           [](auto* value) { return Have {*value}; });
     case ID_BITFIELD:
         // TODO, add get_metadata to all
-      return BitField {std::vector(data.cbegin() + 4  + 1, data.cend())};
+      return BitField {data.subspan(4 + 1)};
     case ID_REQUEST:
       return reinterpret_safely<Request>(data).transform(
           [](auto* value) { return Request {*value}; });
     case ID_PIECE: {
-      auto metadata_size =
-          sizeof(decltype(std::declval<Piece>().get_metadata()));
-      return reinterpret_safely<decltype(std::declval<Piece>().get_metadata())>(
-                 data)
-          .transform(
-              [&](auto* value)
-              {
-                return Piece {
-                    std::vector(data.cbegin() + metadata_size, data.cend()),
-                    *value};
-              });
+      return reinterpret_safely<PieceMetadata>(data).transform(
+          [&](auto* value)
+          { return Piece {data.subspan(sizeof(PieceMetadata)), *value}; });
     }
     case ID_CANCEL:
       return reinterpret_safely<Cancel>(data).transform(
@@ -150,54 +134,154 @@ std::expected<TorrentMessage, ParseError> parse_message(
     case ID_PORT:
       return reinterpret_safely<Port>(data).transform(
           [](auto value) { return Port {*value}; });
+    case ID_SUGGEST_PIECE:
+      return reinterpret_safely<SuggestPiece>(data).transform(
+          [](auto* value) { return SuggestPiece {*value}; });
+    case ID_HAVE_ALL:
+      return HaveAll {};
+    case ID_HAVE_NONE:
+      return HaveNone {};
+    case ID_REJECT_REQUEST:
+      return reinterpret_safely<RejectRequest>(data).transform(
+          [](auto* value) { return RejectRequest {*value}; });
+    case ID_ALLOWED_FAST:
+      return reinterpret_safely<AllowedFast>(data).transform(
+          [](auto* value) { return AllowedFast {*value}; });
+    case ID_EXTENDED:
+      return reinterpret_safely<ExtendedMetadata>(data).transform(
+          [&](auto* value)
+          {
+            return Extended {data.subspan(sizeof(ExtendedMetadata)),
+                             ExtendedMetadata {value->extended_id}};
+          });
     default:
       return std::unexpected(ParseError::UnknownId);
   }
 }
 }  // namespace
 
-awaitable<std::expected<TorrentMessage, ParseError>> read_message(
-    tcp::socket& socket)
+std::optional<std::expected<TorrentMessage, ParseError>> decode_message(
+    ReceiveBuffer& buffer, size_t max_bytes)
 {
-  uint32_big message_length;
+  constexpr size_t length_size = sizeof(uint32_big);
 
-  co_await boost::asio::async_read(
-      socket,
-      boost::asio::buffer(&message_length, sizeof(message_length)),
-      boost::asio::use_awaitable);
+  auto data = buffer.data();
+
+  if (data.size() < length_size) {
+    return std::nullopt;
+  }
+
+  uint32_t message_length = *reinterpret_cast<const uint32_big*>(data.data());
+
+  // Left in the buffer, nothing after it can be decoded anymore
+  if (message_length > max_bytes) {
+    return std::unexpected(ParseError::TooLong);
+  }
+
+  if (data.size() - length_size < message_length) {
+    return std::nullopt;
+  }
+
+  buffer.consume(length_size + message_length);
 
   if (message_length == 0) {
-    co_return Keepalive {};
+    return Keepalive {};
   }
 
-  std::vector<uint8_t> buffer(message_length + sizeof(message_length));
+  auto message = data.first(length_size + message_length);
 
-  *reinterpret_cast<int32_t*>(buffer.data()) = message_length;
+  return parse_message(message[length_size], message);
+}
 
-  co_await boost::asio::async_read(
-      socket, boost::asio::buffer(buffer.data() + sizeof(message_length), message_length), boost::asio::use_awaitable);
+awaitable<size_t> receive_some(tcp::socket& socket,
+                               ReceiveBuffer& buffer,
+                               size_t max_bytes)
+{
+  auto free_space = buffer.prepare(max_bytes);
+
+  auto bytes_read = co_await socket.async_read_some(
+      boost::asio::buffer(free_space.data(), free_space.size()),
+      boost::asio::use_awaitable);
+
+  buffer.commit(bytes_read);
 
-  co_return parse_message(buffer[sizeof(message_length)], buffer);
+  co_return bytes_read;
 }
 
-awaitable<Handshake> read_handshake(tcp::socket& socket)
+std::optional<PieceMetadata> peek_piece_header(const ReceiveBuffer& buffer)
 {
-  Handshake handshake {};
+  auto data = buffer.data();
+
+  if (data.size() < sizeof(PieceMetadata)
+      || data[sizeof(uint32_big)] != ID_PIECE)
+  {
+    return std::nullopt;
+  }
+
+  auto header = *reinterpret_cast<const PieceMetadata*>(data.data());
+
+  if (data.size() - sizeof(PieceMetadata) >= header.block_length()) {
+    return std::nullopt;
+  }
+
+  return header;
+}
+
+awaitable<Piece> read_piece_into(tcp::socket& socket,
+                                 ReceiveBuffer& buffer,
+                                 std::span<uint8_t> destination)
+{
+  auto header = *reinterpret_cast<const PieceMetadata*>(buffer.data().data());
+  auto buffered = buffer.data().subspan(sizeof(PieceMetadata));
+
+  std::ranges::copy(buffered, destination.begin());
+  buffer.consume(sizeof(PieceMetadata) + buffered.size());
+
+  auto remaining = destination.subspan(buffered.size());
 
   co_await boost::asio::async_read(
       socket,
-      boost::asio::buffer(&handshake, sizeof(handshake)),
+      boost::asio::buffer(remaining.data(), remaining.size()),
       boost::asio::use_awaitable);
 
+  co_return Piece {std::span<const uint8_t> {destination}, header};
+}
+
+awaitable<std::expected<TorrentMessage, ParseError>> read_message(
+    tcp::socket& socket, ReceiveBuffer& buffer, size_t max_bytes)
+{
+  while (true) {
+    if (auto message = decode_message(buffer)) {
+      co_return std::move(*message);
+    }
+
+    co_await receive_some(socket, buffer, max_bytes);
+  }
+}
+
+awaitable<Handshake> read_handshake(tcp::socket& socket, ReceiveBuffer& buffer)
+{
+  while (buffer.size() < sizeof(Handshake)) {
+    co_await receive_some(socket, buffer);
+  }
+
+  Handshake handshake {};
+  std::memcpy(&handshake, buffer.data().data(), sizeof(handshake));
+  buffer.consume(sizeof(handshake));
+
   co_return handshake;
 }
 
-awaitable<void> send_handshake(tcp::socket& socket, Handshake handshake)
+awaitable<void> send_handshake(tcp::socket& socket,
+                               Handshake handshake,
+                               SendBatch& batch)
 {
+  std::vector<boost::asio::const_buffer> buffers {
+      boost::asio::buffer(&handshake, sizeof(handshake))};
+  std::ranges::copy(batch.buffers(), std::back_inserter(buffers));
+
   co_await boost::asio::async_write(
-      socket,
-      boost::asio::buffer(&handshake, sizeof(handshake)),
-      boost::asio::use_awaitable);
+      socket, buffers, boost::asio::use_awaitable);
 }
 
 }  // namespace btr
\ No newline at end of file
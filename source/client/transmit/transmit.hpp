@@ -1,9 +1,12 @@
 #pragma once
 
 #include <expected>
+#include <optional>
+#include <vector>
 
 #include <boost/asio.hpp>
 
+#include "client/transmit/receive_buffer.hpp"
 #include "torrent/messages.hpp"
 
 using boost::asio::awaitable;
@@ -11,18 +14,80 @@ using boost::asio::ip::tcp;
 
 namespace btr
 {
-awaitable<void> send_message(tcp::socket& socket, TorrentMessage& message);
+awaitable<void> send_message(tcp::socket& socket,
+                             const TorrentMessage& message);
+
+// Messages queued for a single gathered write
+class SendBatch
+{
+  std::vector<TorrentMessage> m_messages;
+  std::vector<boost::asio::const_buffer> m_buffers;
+  size_t m_bytes = 0;
+
+public:
+  void push(TorrentMessage message);
+
+  void clear();
+
+  bool empty() const;
+
+  size_t bytes() const;
+
+  // Valid until the batch is modified
+  const std::vector<boost::asio::const_buffer>& buffers();
+};
+
+awaitable<void> send_messages(tcp::socket& socket, SendBatch& batch);
 
 enum class ParseError
 {
   LengthMismatch,
   UnknownId,
+
+  // Longer than any message a peer may send, the connection can't be
+  // trusted to stay in sync after it
+  TooLong,
 };
 
+constexpr size_t DEFAULT_READ_BYTES = 64 * 1024;
+
+// Blocks larger than 128 KiB are never sent by well-behaved peers. Other
+// messages are shorter, except the bitfields of torrents with many pieces.
+constexpr size_t MAX_MESSAGE_BYTES = 128 * 1024 + sizeof(PieceMetadata);
+
+// Dynamic payloads of decoded messages view `buffer`, and stay valid
+// until the next read into it
+
+// Takes the next complete message out of `buffer`, if there is one. One whose
+// length prefix exceeds `max_bytes` is rejected before it's buffered.
+std::optional<std::expected<TorrentMessage, ParseError>> decode_message(
+    ReceiveBuffer& buffer, size_t max_bytes = MAX_MESSAGE_BYTES);
+
+// Appends whatever the socket has available, up to `max_bytes`
+awaitable<size_t> receive_some(tcp::socket& socket,
+                               ReceiveBuffer& buffer,
+                               size_t max_bytes = DEFAULT_READ_BYTES);
+
+// Header of a Piece message at the front of `buffer` whose payload hasn't
+// been fully received yet
+std::optional<PieceMetadata> peek_piece_header(const ReceiveBuffer& buffer);
+
+// Completes the Piece message at the front of `buffer`, reading the rest of
+// its payload straight into `destination`, which it borrows
+awaitable<Piece> read_piece_into(tcp::socket& socket,
+                                 ReceiveBuffer& buffer,
+                                 std::span<uint8_t> destination);
+
 awaitable<std::expected<TorrentMessage, ParseError>> read_message(
-    tcp::socket& socket);
+    tcp::socket& socket,
+    ReceiveBuffer& buffer,
+    size_t max_bytes = DEFAULT_READ_BYTES);
 
-awaitable<Handshake> read_handshake(tcp::socket& socket);
+// Whatever the peer sent right after its handshake stays in `buffer`
+awaitable<Handshake> read_handshake(tcp::socket& socket, ReceiveBuffer& buffer);
 
-awaitable<void> send_handshake(tcp::socket& socket, Handshake handshake);
+// The handshake and the messages of `batch` go out in a single write
+awaitable<void> send_handshake(tcp::socket& socket,
+                               Handshake handshake,
+                               SendBatch& batch);
 }  // namespace btr
\ No newline at end of file
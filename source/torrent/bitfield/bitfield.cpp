@@ -63,7 +63,7 @@ bool BitField::is_empty() const
   return indicator == 0;
 }
 
-std::vector<std::uint8_t> BitField::as_raw()
+std::vector<std::uint8_t> BitField::as_raw() const
 {
   return m_bitfield;
 }
@@ -22,6 +22,6 @@ public:
 
   bool is_empty() const;
 
-  std::vector<uint8_t> as_raw();
+  std::vector<uint8_t> as_raw() const;
 };
 }  // namespace aux
\ No newline at end of file
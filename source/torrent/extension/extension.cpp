@@ -0,0 +1,226 @@
+#include <algorithm>
+#include <string>
+
+#include "torrent/extension/extension.hpp"
+
+#include "torrent/metadata/bencode.hpp"
+
+using bencode::BeValueTypeIndex;
+using bencode::Dict;
+
+namespace btr
+{
+namespace
+{
+constexpr size_t PORT_SIZE = 2;
+constexpr size_t COMPACT_V4_SIZE = 4 + PORT_SIZE;
+constexpr size_t COMPACT_V6_SIZE = 16 + PORT_SIZE;
+
+std::optional<Dict> decode_dict(std::span<const uint8_t> payload)
+{
+  // The decoder peeks one past the end, std::string keeps that in bounds
+  std::string encoded(payload.begin(), payload.end());
+
+  try {
+    auto value = bencode::BDecoder {}(encoded);
+
+    if (value.which() != BeValueTypeIndex::IDict) {
+      return std::nullopt;
+    }
+
+    return boost::get<Dict>(value);
+  } catch (const std::exception&) {
+    return std::nullopt;
+  }
+}
+
+Extended make_extended(uint8_t extended_id, const Dict& dict)
+{
+  bencode::BEncoder encoder;
+  auto encoded = encoder(dict);
+
+  return Extended {std::vector<uint8_t>(encoded.cbegin(), encoded.cend()),
+                   ExtendedMetadata {extended_id}};
+}
+
+template<typename Bytes>
+void append_compact(std::string& compact,
+                    const Bytes& address,
+                    boost::asio::ip::port_type port)
+{
+  compact.append(address.cbegin(), address.cend());
+  compact.push_back(static_cast<char>(port >> 8));
+  compact.push_back(static_cast<char>(port & 0xff));
+}
+
+template<typename Address>
+void parse_compact(const Dict& dict,
+                   const std::string& field_name,
+                   std::vector<PeerContactInfo>& contacts)
+{
+  auto field = dict.find(field_name);
+
+  if (field == dict.end()
+      || field->second.which() != BeValueTypeIndex::IString)
+  {
+    return;
+  }
+
+  const auto& compact = boost::get<std::string>(field->second);
+
+  typename Address::bytes_type bytes {};
+  auto entry_size = bytes.size() + PORT_SIZE;
+
+  for (size_t offset = 0; offset + entry_size <= compact.size();
+       offset += entry_size)
+  {
+    std::copy_n(compact.cbegin() + static_cast<std::ptrdiff_t>(offset),
+                bytes.size(),
+                bytes.begin());
+
+    auto port_offset = offset + bytes.size();
+    auto port = static_cast<boost::asio::ip::port_type>(
+        (static_cast<uint8_t>(compact[port_offset]) << 8)
+        | static_cast<uint8_t>(compact[port_offset + 1]));
+
+    contacts.emplace_back(Address {bytes}, port);
+  }
+}
+}  // namespace
+
+Extended make_extended_handshake()
+{
+  Dict extensions {{"ut_pex", std::int64_t {LOCAL_UT_PEX_ID}}};
+
+  Dict handshake {{"m", extensions}, {"v", std::string {"torrenter"}}};
+
+  return make_extended(EXTENDED_HANDSHAKE_ID, handshake);
+}
+
+std::optional<ExtendedHandshake> parse_extended_handshake(
+    std::span<const uint8_t> payload)
+{
+  auto handshake = decode_dict(payload);
+
+  if (!handshake) {
+    return std::nullopt;
+  }
+
+  ExtendedHandshake result {};
+
+  auto extensions = handshake->find("m");
+
+  if (extensions == handshake->end()
+      || extensions->second.which() != BeValueTypeIndex::IDict)
+  {
+    return result;
+  }
+
+  const auto& ids = boost::get<Dict>(extensions->second);
+  auto ut_pex = ids.find("ut_pex");
+
+  // An id of 0 means the extension got disabled
+  if (ut_pex != ids.end()
+      && ut_pex->second.which() == BeValueTypeIndex::IInt64)
+  {
+    auto id = boost::get<std::int64_t>(ut_pex->second);
+
+    if (0 < id && id <= UINT8_MAX) {
+      result.ut_pex_id = static_cast<uint8_t>(id);
+    }
+  }
+
+  return result;
+}
+
+bool PeerExchangeDelta::empty() const
+{
+  return added.empty() && dropped.empty();
+}
+
+PeerExchangeDelta PeerExchangeState::next(
+    std::span<const PeerContactInfo> swarm) const
+{
+  PeerExchangeDelta delta;
+  std::set<PeerContactInfo> current(swarm.begin(), swarm.end());
+
+  for (const auto& contact : swarm) {
+    if (delta.added.size() < MAX_PEX_PEERS
+        && !m_advertised.contains(contact)
+        && !std::ranges::contains(delta.added, contact))
+    {
+      delta.added.push_back(contact);
+    }
+  }
+
+  for (const auto& contact : m_advertised) {
+    if (delta.dropped.size() < MAX_PEX_PEERS && !current.contains(contact)) {
+      delta.dropped.push_back(contact);
+    }
+  }
+
+  return delta;
+}
+
+void PeerExchangeState::advance(const PeerExchangeDelta& delta)
+{
+  m_advertised.insert(delta.added.cbegin(), delta.added.cend());
+
+  for (const auto& contact : delta.dropped) {
+    m_advertised.erase(contact);
+  }
+}
+
+Extended make_peer_exchange(uint8_t remote_ut_pex_id,
+                            const PeerExchangeDelta& delta)
+{
+  std::string added_v4;
+  std::string added_v6;
+  std::string dropped_v4;
+  std::string dropped_v6;
+
+  auto append = [](std::span<const PeerContactInfo> contacts,
+                   std::string& compact_v4,
+                   std::string& compact_v6)
+  {
+    for (const auto& contact :
+         contacts.first(std::min(contacts.size(), MAX_PEX_PEERS)))
+    {
+      if (contact.address.is_v4()) {
+        append_compact(
+            compact_v4, contact.address.to_v4().to_bytes(), contact.port);
+      } else {
+        append_compact(
+            compact_v6, contact.address.to_v6().to_bytes(), contact.port);
+      }
+    }
+  };
+
+  append(delta.added, added_v4, added_v6);
+  append(delta.dropped, dropped_v4, dropped_v6);
+
+  // No flags are known about the added peers
+  Dict exchange {
+      {"added", added_v4},
+      {"added.f", std::string(added_v4.size() / COMPACT_V4_SIZE, '\0')},
+      {"added6", added_v6},
+      {"added6.f", std::string(added_v6.size() / COMPACT_V6_SIZE, '\0')},
+      {"dropped", dropped_v4},
+      {"dropped6", dropped_v6}};
+
+  return make_extended(remote_ut_pex_id, exchange);
+}
+
+std::vector<PeerContactInfo> parse_peer_exchange(
+    std::span<const uint8_t> payload)
+{
+  std::vector<PeerContactInfo> contacts;
+
+  if (auto exchange = decode_dict(payload)) {
+    parse_compact<boost::asio::ip::address_v4>(*exchange, "added", contacts);
+    parse_compact<boost::asio::ip::address_v6>(*exchange, "added6", contacts);
+  }
+
+  return contacts;
+}
+}  // namespace btr
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <set>
+#include <span>
+#include <vector>
+
+#include "client/context.hpp"
+#include "torrent/messages.hpp"
+
+namespace btr
+{
+constexpr uint8_t EXTENDED_HANDSHAKE_ID = 0;
+
+// Advertised in our extended handshake, peers address their messages with it
+constexpr uint8_t LOCAL_UT_PEX_ID = 1;
+
+// BEP 11 caps the peers added, and the peers dropped, by a single message
+constexpr size_t MAX_PEX_PEERS = 50;
+
+struct ExtendedHandshake
+{
+  std::optional<uint8_t> ut_pex_id;
+};
+
+Extended make_extended_handshake();
+
+std::optional<ExtendedHandshake> parse_extended_handshake(
+    std::span<const uint8_t> payload);
+
+// Changes to the swarm since the previous ut_pex message
+struct PeerExchangeDelta
+{
+  std::vector<PeerContactInfo> added;
+  std::vector<PeerContactInfo> dropped;
+
+  bool empty() const;
+};
+
+/*
+ * The swarm as a peer was told about it over ut_pex. Messages only carry
+ * the changes since the previous one, at most MAX_PEX_PEERS added and as
+ * many dropped peers, so a large swarm is advertised over several rounds.
+ */
+class PeerExchangeState
+{
+  std::set<PeerContactInfo> m_advertised;
+
+public:
+  // The changes the next message should carry, given the current swarm
+  PeerExchangeDelta next(std::span<const PeerContactInfo> swarm) const;
+
+  // The peer was sent `delta`
+  void advance(const PeerExchangeDelta& delta);
+};
+
+Extended make_peer_exchange(uint8_t remote_ut_pex_id,
+                            const PeerExchangeDelta& delta);
+
+// Peers added by a ut_pex message, dropped ones are ignored
+std::vector<PeerContactInfo> parse_peer_exchange(
+    std::span<const uint8_t> payload);
+}  // namespace btr
@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+#include "torrent/hash/sha1.hpp"
+
+#include "torrent/hash/sha1_kernels.hpp"
+
+namespace btr::sha1
+{
+namespace
+{
+using detail::BLOCK_BYTES;
+using detail::LANES;
+using detail::State;
+
+constexpr State INITIAL_STATE {
+    0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+
+// Padding and length of a message, one or two blocks
+struct Tail
+{
+  std::array<uint8_t, 2 * BLOCK_BYTES> bytes {};
+  size_t blocks = 0;
+};
+
+Tail make_tail(std::span<const uint8_t> message)
+{
+  Tail tail {};
+
+  auto remainder = message.size() % BLOCK_BYTES;
+
+  if (remainder > 0) {
+    std::memcpy(tail.bytes.data(),
+                message.data() + message.size() - remainder,
+                remainder);
+  }
+
+  tail.bytes[remainder] = 0x80;
+
+  tail.blocks = remainder + 1 + sizeof(uint64_t) <= BLOCK_BYTES ? 1 : 2;
+
+  auto bit_length = static_cast<uint64_t>(message.size()) * 8;
+
+  for (size_t i = 0; i < sizeof(uint64_t); i++) {
+    tail.bytes[tail.blocks * BLOCK_BYTES - 1 - i] =
+        static_cast<uint8_t>(bit_length >> (8 * i));
+  }
+
+  return tail;
+}
+
+Digest to_digest(const State& state)
+{
+  Digest digest {};
+
+  for (size_t i = 0; i < state.size(); i++) {
+    for (size_t j = 0; j < sizeof(uint32_t); j++) {
+      digest[i * 4 + j] = static_cast<uint8_t>(state[i] >> (24 - 8 * j));
+    }
+  }
+
+  return digest;
+}
+
+using compress_t = void (*)(State&, const uint8_t*, size_t);
+
+Digest hash_with(compress_t compress, std::span<const uint8_t> message)
+{
+  auto state = INITIAL_STATE;
+  auto tail = make_tail(message);
+
+  compress(state, message.data(), message.size() / BLOCK_BYTES);
+  compress(state, tail.bytes.data(), tail.blocks);
+
+  return to_digest(state);
+}
+
+// Up to LANES messages of the same length, idle lanes repeat the first one
+void hash_lanes(std::span<const std::span<const uint8_t>> messages,
+                std::span<const size_t> indexes,
+                std::span<Digest> digests)
+{
+  std::array<State, LANES> states {};
+  std::array<const uint8_t*, LANES> blocks {};
+  std::array<Tail, LANES> tails {};
+
+  for (size_t lane = 0; lane < LANES; lane++) {
+    auto index = indexes[std::min(lane, indexes.size() - 1)];
+
+    states[lane] = INITIAL_STATE;
+    blocks[lane] = messages[index].data();
+    tails[lane] = make_tail(messages[index]);
+  }
+
+  detail::compress_avx2_x8(
+      states, blocks, messages[indexes.front()].size() / BLOCK_BYTES);
+
+  for (size_t lane = 0; lane < LANES; lane++) {
+    blocks[lane] = tails[lane].bytes.data();
+  }
+
+  detail::compress_avx2_x8(states, blocks, tails.front().blocks);
+
+  for (size_t lane = 0; lane < indexes.size(); lane++) {
+    digests[indexes[lane]] = to_digest(states[lane]);
+  }
+}
+
+void hash_many_avx2(std::span<const std::span<const uint8_t>> messages,
+                    std::span<Digest> digests)
+{
+  std::vector<size_t> indexes(messages.size());
+  std::iota(indexes.begin(), indexes.end(), 0);
+
+  std::ranges::stable_sort(indexes,
+                           {},
+                           [&](size_t index) { return messages[index].size(); });
+
+  for (auto run = indexes.begin(); run != indexes.end();) {
+    auto run_end = std::find_if(run,
+                                indexes.end(),
+                                [&](size_t index)
+                                {
+                                  return messages[index].size()
+                                      != messages[*run].size();
+                                });
+
+    while (run != run_end) {
+      auto lanes = std::min<size_t>(LANES, static_cast<size_t>(run_end - run));
+
+      // A lone message is faster on a single lane
+      if (lanes == 1) {
+        digests[*run] = hash_with(detail::compress_scalar, messages[*run]);
+      } else {
+        hash_lanes(messages, std::span {&*run, lanes}, digests);
+      }
+
+      run += static_cast<std::ptrdiff_t>(lanes);
+    }
+  }
+}
+
+compress_t single_buffer_compress(Kernel kernel)
+{
+  return kernel == Kernel::ShaNi ? detail::compress_sha_ni
+                                 : detail::compress_scalar;
+}
+}  // namespace
+
+bool is_supported(Kernel kernel)
+{
+  switch (kernel) {
+    case Kernel::ShaNi:
+      return detail::cpu_supports_sha_ni();
+    case Kernel::Avx2MultiBuffer:
+      return detail::cpu_supports_avx2();
+    default:
+      return true;
+  }
+}
+
+Kernel best_kernel()
+{
+  static const Kernel kernel = []
+  {
+    if (is_supported(Kernel::ShaNi)) {
+      return Kernel::ShaNi;
+    }
+
+    if (is_supported(Kernel::Avx2MultiBuffer)) {
+      return Kernel::Avx2MultiBuffer;
+    }
+
+    return Kernel::Scalar;
+  }();
+
+  return kernel;
+}
+
+Digest hash(std::span<const uint8_t> message)
+{
+  return hash_with(single_buffer_compress(best_kernel()), message);
+}
+
+void hash_many(std::span<const std::span<const uint8_t>> messages,
+               std::span<Digest> digests)
+{
+  hash_many(messages, digests, best_kernel());
+}
+
+void hash_many(std::span<const std::span<const uint8_t>> messages,
+               std::span<Digest> digests,
+               Kernel kernel)
+{
+  if (!is_supported(kernel)) {
+    throw std::invalid_argument("SHA-1 kernel isn't supported by this CPU");
+  }
+
+  if (digests.size() < messages.size()) {
+    throw std::invalid_argument("Not enough room for the digests");
+  }
+
+  if (kernel == Kernel::Avx2MultiBuffer) {
+    hash_many_avx2(messages, digests);
+    return;
+  }
+
+  for (size_t i = 0; i < messages.size(); i++) {
+    digests[i] = hash_with(single_buffer_compress(kernel), messages[i]);
+  }
+}
+
+namespace detail
+{
+void compress_scalar(State& state, const uint8_t* blocks, size_t count)
+{
+  for (; count > 0; count--, blocks += BLOCK_BYTES) {
+    // Rolling message schedule, the last 16 words are all a round needs
+    uint32_t w[16];
+
+    for (size_t t = 0; t < 16; t++) {
+      w[t] = uint32_t {blocks[4 * t]} << 24 | uint32_t {blocks[4 * t + 1]} << 16
+          | uint32_t {blocks[4 * t + 2]} << 8 | uint32_t {blocks[4 * t + 3]};
+    }
+
+    auto a = state[0];
+    auto b = state[1];
+    auto c = state[2];
+    auto d = state[3];
+    auto e = state[4];
+
+    auto round = [&](size_t t, uint32_t f, uint32_t k)
+    {
+      if (t >= 16) {
+        w[t % 16] = std::rotl(
+            w[(t - 3) % 16] ^ w[(t - 8) % 16] ^ w[(t - 14) % 16] ^ w[t % 16],
+            1);
+      }
+
+      auto temp = std::rotl(a, 5) + f + e + k + w[t % 16];
+      e = d;
+      d = c;
+      c = std::rotl(b, 30);
+      b = a;
+      a = temp;
+    };
+
+    for (size_t t = 0; t < 20; t++) {
+      round(t, d ^ (b & (c ^ d)), 0x5A827999);
+    }
+
+    for (size_t t = 20; t < 40; t++) {
+      round(t, b ^ c ^ d, 0x6ED9EBA1);
+    }
+
+    for (size_t t = 40; t < 60; t++) {
+      round(t, (b & c) | (d & (b | c)), 0x8F1BBCDC);
+    }
+
+    for (size_t t = 60; t < 80; t++) {
+      round(t, b ^ c ^ d, 0xCA62C1D6);
+    }
+
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+  }
+}
+}  // namespace detail
+}  // namespace btr::sha1
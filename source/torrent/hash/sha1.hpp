@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace btr::sha1
+{
+using Digest = std::array<uint8_t, 20>;
+
+enum class Kernel : uint8_t
+{
+  Scalar,
+  // One message at a time on the SHA extensions
+  ShaNi,
+  // Eight messages at a time in AVX2 lanes, for CPUs without SHA-NI
+  Avx2MultiBuffer,
+};
+
+bool is_supported(Kernel kernel);
+
+// Fastest supported kernel, detected once at runtime
+Kernel best_kernel();
+
+Digest hash(std::span<const uint8_t> message);
+
+// Hashes independent messages, such as the pieces of a recheck. Messages of
+// equal length are hashed side by side when the kernel allows it.
+void hash_many(std::span<const std::span<const uint8_t>> messages,
+               std::span<Digest> digests);
+
+void hash_many(std::span<const std::span<const uint8_t>> messages,
+               std::span<Digest> digests,
+               Kernel kernel);
+}  // namespace btr::sha1
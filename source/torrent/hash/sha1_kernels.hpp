@@ -0,0 +1,27 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Compression functions behind sha1.hpp, each consumes whole 64 byte blocks
+namespace btr::sha1::detail
+{
+constexpr size_t BLOCK_BYTES = 64;
+constexpr size_t LANES = 8;
+
+using State = std::array<uint32_t, 5>;
+
+void compress_scalar(State& state, const uint8_t* blocks, size_t count);
+
+bool cpu_supports_sha_ni();
+
+bool cpu_supports_avx2();
+
+void compress_sha_ni(State& state, const uint8_t* blocks, size_t count);
+
+// Lane i compresses `count` blocks starting at blocks[i] into states[i]
+void compress_avx2_x8(std::array<State, LANES>& states,
+                      const std::array<const uint8_t*, LANES>& blocks,
+                      size_t count);
+}  // namespace btr::sha1::detail
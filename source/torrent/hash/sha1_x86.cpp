@@ -0,0 +1,350 @@
+#include <cstring>
+#include <utility>
+
+#include "torrent/hash/sha1_kernels.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) \
+    || defined(_M_IX86)
+#  define BTR_SHA1_X86
+#endif
+
+#ifdef BTR_SHA1_X86
+#  include <immintrin.h>
+#  ifdef _MSC_VER
+#    include <intrin.h>
+#    define SHA_NI_TARGET
+#    define AVX2_TARGET
+#  else
+#    include <cpuid.h>
+#    define SHA_NI_TARGET __attribute__((target("sha,ssse3,sse4.1")))
+#    define AVX2_TARGET __attribute__((target("avx2")))
+#  endif
+#endif
+
+namespace btr::sha1::detail
+{
+#ifdef BTR_SHA1_X86
+namespace
+{
+struct CpuFeatures
+{
+  bool sha_ni = false;
+  bool avx2 = false;
+};
+
+void cpuid(uint32_t leaf, uint32_t (&registers)[4])
+{
+#  ifdef _MSC_VER
+  int values[4];
+  __cpuidex(values, static_cast<int>(leaf), 0);
+  std::memcpy(registers, values, sizeof(values));
+#  else
+  __cpuid_count(leaf, 0, registers[0], registers[1], registers[2], registers[3]);
+#  endif
+}
+
+uint64_t enabled_register_state()
+{
+#  ifdef _MSC_VER
+  return _xgetbv(0);
+#  else
+  uint32_t low = 0;
+  uint32_t high = 0;
+  __asm__("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+  return uint64_t {high} << 32 | low;
+#  endif
+}
+
+CpuFeatures detect_features()
+{
+  uint32_t leaf0[4] {};
+  cpuid(0, leaf0);
+
+  if (leaf0[0] < 7) {
+    return {};
+  }
+
+  uint32_t leaf1[4] {};
+  uint32_t leaf7[4] {};
+  cpuid(1, leaf1);
+  cpuid(7, leaf7);
+
+  auto bit = [](uint32_t value, int index) { return (value >> index) & 1; };
+
+  bool ssse3 = bit(leaf1[2], 9);
+  bool sse41 = bit(leaf1[2], 19);
+  bool avx = bit(leaf1[2], 28);
+
+  // The OS must save the YMM registers for AVX to be usable
+  bool ymm_enabled =
+      bit(leaf1[2], 27) && (enabled_register_state() & 0x6) == 0x6;
+
+  return {.sha_ni = ssse3 && sse41 && bit(leaf7[1], 29),
+          .avx2 = avx && ymm_enabled && bit(leaf7[1], 5)};
+}
+
+const CpuFeatures& features()
+{
+  static const CpuFeatures detected = detect_features();
+  return detected;
+}
+
+// Four rounds, SHA-NI interleaves them with the message schedule
+template<size_t Group>
+SHA_NI_TARGET inline void rounds_sha_ni(__m128i& abcd,
+                                        __m128i (&e)[2],
+                                        __m128i (&msg)[4],
+                                        const uint8_t* block,
+                                        __m128i byte_swap)
+{
+  auto& current = e[Group % 2];
+  auto& next = e[(Group + 1) % 2];
+
+  if constexpr (Group < 4) {
+    msg[Group] = _mm_shuffle_epi8(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16 * Group)),
+        byte_swap);
+  }
+
+  if constexpr (Group == 0) {
+    current = _mm_add_epi32(current, msg[0]);
+  } else {
+    current = _mm_sha1nexte_epu32(current, msg[Group % 4]);
+  }
+
+  next = abcd;
+
+  if constexpr (Group >= 3 && Group <= 18) {
+    msg[(Group + 1) % 4] =
+        _mm_sha1msg2_epu32(msg[(Group + 1) % 4], msg[Group % 4]);
+  }
+
+  abcd = _mm_sha1rnds4_epu32(abcd, current, Group / 5);
+
+  if constexpr (Group >= 1 && Group <= 16) {
+    msg[(Group + 3) % 4] =
+        _mm_sha1msg1_epu32(msg[(Group + 3) % 4], msg[Group % 4]);
+  }
+
+  if constexpr (Group >= 2 && Group <= 17) {
+    msg[(Group + 2) % 4] = _mm_xor_si128(msg[(Group + 2) % 4], msg[Group % 4]);
+  }
+}
+
+template<size_t... Groups>
+SHA_NI_TARGET inline void block_sha_ni(__m128i& abcd,
+                                       __m128i (&e)[2],
+                                       const uint8_t* block,
+                                       __m128i byte_swap,
+                                       std::index_sequence<Groups...>)
+{
+  __m128i msg[4];
+  (rounds_sha_ni<Groups>(abcd, e, msg, block, byte_swap), ...);
+}
+
+template<int Bits>
+AVX2_TARGET inline __m256i rotl_avx2(__m256i value)
+{
+  return _mm256_or_si256(_mm256_slli_epi32(value, Bits),
+                         _mm256_srli_epi32(value, 32 - Bits));
+}
+
+// Turns eight rows of eight words into eight columns
+AVX2_TARGET inline void transpose_avx2(__m256i (&rows)[8])
+{
+  __m256i t[8];
+  __m256i u[8];
+
+  for (int i = 0; i < 4; i++) {
+    t[2 * i] = _mm256_unpacklo_epi32(rows[2 * i], rows[2 * i + 1]);
+    t[2 * i + 1] = _mm256_unpackhi_epi32(rows[2 * i], rows[2 * i + 1]);
+  }
+
+  for (int i = 0; i < 2; i++) {
+    u[4 * i] = _mm256_unpacklo_epi64(t[4 * i], t[4 * i + 2]);
+    u[4 * i + 1] = _mm256_unpackhi_epi64(t[4 * i], t[4 * i + 2]);
+    u[4 * i + 2] = _mm256_unpacklo_epi64(t[4 * i + 1], t[4 * i + 3]);
+    u[4 * i + 3] = _mm256_unpackhi_epi64(t[4 * i + 1], t[4 * i + 3]);
+  }
+
+  for (int i = 0; i < 4; i++) {
+    rows[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+    rows[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+  }
+}
+}  // namespace
+
+bool cpu_supports_sha_ni()
+{
+  return features().sha_ni;
+}
+
+bool cpu_supports_avx2()
+{
+  return features().avx2;
+}
+
+SHA_NI_TARGET void compress_sha_ni(State& state,
+                                   const uint8_t* blocks,
+                                   size_t count)
+{
+  const __m128i byte_swap =
+      _mm_set_epi64x(0x0001020304050607LL, 0x08090a0b0c0d0e0fLL);
+
+  __m128i abcd = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(state.data())), 0x1B);
+  __m128i e[2] = {_mm_set_epi32(static_cast<int>(state[4]), 0, 0, 0),
+                  _mm_setzero_si128()};
+
+  for (; count > 0; count--, blocks += BLOCK_BYTES) {
+    auto abcd_save = abcd;
+    auto e_save = e[0];
+
+    block_sha_ni(abcd, e, blocks, byte_swap, std::make_index_sequence<20> {});
+
+    e[0] = _mm_sha1nexte_epu32(e[0], e_save);
+    abcd = _mm_add_epi32(abcd, abcd_save);
+  }
+
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(state.data()),
+                   _mm_shuffle_epi32(abcd, 0x1B));
+  state[4] = static_cast<uint32_t>(_mm_extract_epi32(e[0], 3));
+}
+
+AVX2_TARGET void compress_avx2_x8(std::array<State, LANES>& states,
+                                  const std::array<const uint8_t*, LANES>& blocks,
+                                  size_t count)
+{
+  const __m256i byte_swap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9,
+                                             8, 15, 14, 13, 12, 3, 2, 1, 0, 7,
+                                             6, 5, 4, 11, 10, 9, 8, 15, 14, 13,
+                                             12);
+
+  alignas(32) uint32_t columns[5][LANES];
+
+  for (size_t lane = 0; lane < LANES; lane++) {
+    for (size_t word = 0; word < 5; word++) {
+      columns[word][lane] = states[lane][word];
+    }
+  }
+
+  __m256i h[5];
+
+  for (size_t word = 0; word < 5; word++) {
+    h[word] = _mm256_load_si256(reinterpret_cast<const __m256i*>(columns[word]));
+  }
+
+  for (size_t block = 0; block < count; block++) {
+    __m256i w[16];
+
+    for (size_t half = 0; half < 2; half++) {
+      __m256i rows[8];
+
+      for (size_t lane = 0; lane < LANES; lane++) {
+        rows[lane] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(
+            blocks[lane] + block * BLOCK_BYTES + half * 32));
+      }
+
+      transpose_avx2(rows);
+
+      for (size_t i = 0; i < 8; i++) {
+        w[half * 8 + i] = _mm256_shuffle_epi8(rows[i], byte_swap);
+      }
+    }
+
+    auto a = h[0];
+    auto b = h[1];
+    auto c = h[2];
+    auto d = h[3];
+    auto e = h[4];
+
+    auto round = [&](size_t t, __m256i f, __m256i k) AVX2_TARGET
+    {
+      if (t >= 16) {
+        w[t % 16] = rotl_avx2<1>(_mm256_xor_si256(
+            _mm256_xor_si256(w[(t - 3) % 16], w[(t - 8) % 16]),
+            _mm256_xor_si256(w[(t - 14) % 16], w[t % 16])));
+      }
+
+      auto temp = _mm256_add_epi32(
+          _mm256_add_epi32(rotl_avx2<5>(a), f),
+          _mm256_add_epi32(_mm256_add_epi32(e, k), w[t % 16]));
+
+      e = d;
+      d = c;
+      c = rotl_avx2<30>(b);
+      b = a;
+      a = temp;
+    };
+
+    for (size_t t = 0; t < 20; t++) {
+      round(t,
+            _mm256_xor_si256(d, _mm256_and_si256(b, _mm256_xor_si256(c, d))),
+            _mm256_set1_epi32(0x5A827999));
+    }
+
+    for (size_t t = 20; t < 40; t++) {
+      round(t,
+            _mm256_xor_si256(_mm256_xor_si256(b, c), d),
+            _mm256_set1_epi32(0x6ED9EBA1));
+    }
+
+    for (size_t t = 40; t < 60; t++) {
+      round(t,
+            _mm256_or_si256(_mm256_and_si256(b, c),
+                            _mm256_and_si256(d, _mm256_or_si256(b, c))),
+            _mm256_set1_epi32(static_cast<int>(0x8F1BBCDC)));
+    }
+
+    for (size_t t = 60; t < 80; t++) {
+      round(t,
+            _mm256_xor_si256(_mm256_xor_si256(b, c), d),
+            _mm256_set1_epi32(static_cast<int>(0xCA62C1D6)));
+    }
+
+    h[0] = _mm256_add_epi32(h[0], a);
+    h[1] = _mm256_add_epi32(h[1], b);
+    h[2] = _mm256_add_epi32(h[2], c);
+    h[3] = _mm256_add_epi32(h[3], d);
+    h[4] = _mm256_add_epi32(h[4], e);
+  }
+
+  for (size_t word = 0; word < 5; word++) {
+    _mm256_store_si256(reinterpret_cast<__m256i*>(columns[word]), h[word]);
+  }
+
+  for (size_t lane = 0; lane < LANES; lane++) {
+    for (size_t word = 0; word < 5; word++) {
+      states[lane][word] = columns[word][lane];
+    }
+  }
+}
+
+#else
+
+bool cpu_supports_sha_ni()
+{
+  return false;
+}
+
+bool cpu_supports_avx2()
+{
+  return false;
+}
+
+void compress_sha_ni(State& state, const uint8_t* blocks, size_t count)
+{
+  compress_scalar(state, blocks, count);
+}
+
+void compress_avx2_x8(std::array<State, LANES>& states,
+                      const std::array<const uint8_t*, LANES>& blocks,
+                      size_t count)
+{
+  for (size_t lane = 0; lane < LANES; lane++) {
+    compress_scalar(states[lane], blocks[lane], count);
+  }
+}
+
+#endif  // BTR_SHA1_X86
+}  // namespace btr::sha1::detail
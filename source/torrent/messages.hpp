@@ -4,8 +4,11 @@
 #include <array>
 #include <climits>
 #include <cstddef>
+#include <memory>
+#include <span>
 #include <tuple>
 #include <variant>
+#include <vector>
 
 #include "auxiliary/big_endian.hpp"
 #include "client/context.hpp"
@@ -36,6 +39,22 @@ constexpr uint8_t ID_PIECE = 7;
 constexpr uint8_t ID_CANCEL = 8;
 constexpr uint8_t ID_PORT = 9;
 
+// BEP 6, Fast Extension
+constexpr uint8_t ID_SUGGEST_PIECE = 13;
+constexpr uint8_t ID_HAVE_ALL = 14;
+constexpr uint8_t ID_HAVE_NONE = 15;
+constexpr uint8_t ID_REJECT_REQUEST = 16;
+constexpr uint8_t ID_ALLOWED_FAST = 17;
+
+constexpr size_t FAST_EXTENSION_RESERVED_BYTE = 7;
+constexpr uint8_t FAST_EXTENSION_RESERVED_MASK = 0x04;
+
+// BEP 10, Extension Protocol
+constexpr uint8_t ID_EXTENDED = 20;
+
+constexpr size_t EXTENSION_PROTOCOL_RESERVED_BYTE = 5;
+constexpr uint8_t EXTENSION_PROTOCOL_RESERVED_MASK = 0x10;
+
 template<uint8_t Length>
 struct PACKED_ATTRIBUTE FixedString
 {
@@ -55,10 +74,28 @@ struct PACKED_ATTRIBUTE Handshake
     std::copy(id.as_raw().cbegin(), id.as_raw().cend(), peer_id);
 
     std::copy(context.info_hash.cbegin(), context.info_hash.cend(), infohash);
+
+    reserved[FAST_EXTENSION_RESERVED_BYTE] |= FAST_EXTENSION_RESERVED_MASK;
+    reserved[EXTENSION_PROTOCOL_RESERVED_BYTE] |=
+        EXTENSION_PROTOCOL_RESERVED_MASK;
   }
 
   Handshake() = default;
 
+  bool supports_fast_extension() const
+  {
+    return (reserved[FAST_EXTENSION_RESERVED_BYTE]
+            & FAST_EXTENSION_RESERVED_MASK)
+        != 0;
+  }
+
+  bool supports_extension_protocol() const
+  {
+    return (reserved[EXTENSION_PROTOCOL_RESERVED_BYTE]
+            & EXTENSION_PROTOCOL_RESERVED_MASK)
+        != 0;
+  }
+
   int8_t plen = 19;
   FixedString<19> pname {"BitTorrent protocol"};
   uint8_t reserved[8] {0};
@@ -110,6 +147,14 @@ public:
 
 struct PACKED_ATTRIBUTE Cancel
 {
+  Cancel() = default;
+  Cancel(uint32_t piece_index, uint32_t offset_within_piece, uint32_t length)
+      : piece_index {piece_index}
+      , offset_within_piece {offset_within_piece}
+      , length {length}
+  {
+  }
+
 private:
   MessageMetadata<13, ID_CANCEL> metadata;
 
@@ -128,10 +173,51 @@ public:
   uint16_big port;
 };
 
+struct PACKED_ATTRIBUTE SuggestPiece
+{
+private:
+  MessageMetadata<5, ID_SUGGEST_PIECE> metadata;
+
+public:
+  uint32_big piece_index;
+};
+
+struct PACKED_ATTRIBUTE RejectRequest
+{
+  RejectRequest() = default;
+  RejectRequest(uint32_t piece_index,
+                uint32_t offset_within_piece,
+                uint32_t length)
+      : piece_index {piece_index}
+      , offset_within_piece {offset_within_piece}
+      , length {length}
+  {
+  }
+
+private:
+  MessageMetadata<13, ID_REJECT_REQUEST> metadata;
+
+public:
+  uint32_big piece_index;
+  uint32_big offset_within_piece;
+  uint32_big length;
+};
+
+struct PACKED_ATTRIBUTE AllowedFast
+{
+private:
+  MessageMetadata<5, ID_ALLOWED_FAST> metadata;
+
+public:
+  uint32_big piece_index;
+};
+
 using Choke = MessageMetadata<1, ID_CHOKE>;
 using Unchoke = MessageMetadata<1, ID_UNCHOKE>;
 using Interested = MessageMetadata<1, ID_INTERESTED>;
 using NotInterested = MessageMetadata<1, ID_NOT_INTERESTED>;
+using HaveAll = MessageMetadata<1, ID_HAVE_ALL>;
+using HaveNone = MessageMetadata<1, ID_HAVE_NONE>;
 
 // dynamic length messages
 
@@ -139,6 +225,12 @@ struct PACKED_ATTRIBUTE PieceMetadata
 {
   void add_length(uint32_t some_length) { metadata.add_length(some_length); }
 
+  uint32_t block_length() const
+  {
+    return metadata.length
+        - static_cast<uint32_t>(sizeof(PieceMetadata) - sizeof(uint32_big));
+  }
+
 private:
   MessageMetadata<9, ID_PIECE> metadata;
 
@@ -147,32 +239,82 @@ public:
   uint32_big offset_within_piece;
 };
 
+struct PACKED_ATTRIBUTE ExtendedMetadata
+{
+  ExtendedMetadata(uint8_t extended_id = 0)
+      : extended_id {extended_id}
+  {
+  }
+
+  void add_length(uint32_t some_length) { metadata.add_length(some_length); }
+
+private:
+  MessageMetadata<2, ID_EXTENDED> metadata;
+
+public:
+  uint8_t extended_id;
+};
+
+#pragma pack(pop)
+
 template<typename T>
 concept SupportsDynamicLength = requires(T metadata, uint32_t some_length) {
   metadata.add_length(some_length);
 };
 
+/*
+ * Move-only, the payload is either shared or borrowed so moving a message
+ * along never copies its bytes. Use share() for another handle to the same
+ * payload.
+ */
 template<SupportsDynamicLength Metadata>
 struct DynamicLengthMessage
 {
   DynamicLengthMessage(std::vector<uint8_t> data, Metadata metadata = {})
+      : DynamicLengthMessage {
+            std::make_shared<const std::vector<uint8_t>>(std::move(data)),
+            metadata}
+  {
+  }
+
+  DynamicLengthMessage(std::shared_ptr<const std::vector<uint8_t>> data,
+                       Metadata metadata = {})
       : m_metadata {metadata}
-      , m_payload {std::move(data)}
+      , m_owner {std::move(data)}
+      , m_payload {*m_owner}
   {
-    m_metadata.add_length(m_payload.size());
+    m_metadata.add_length(static_cast<uint32_t>(m_payload.size()));
   }
 
-  std::vector<uint8_t> get_payload() const { return m_payload; }
+  // Borrows the payload, the viewed bytes must outlive the message
+  DynamicLengthMessage(std::span<const uint8_t> data, Metadata metadata = {})
+      : m_metadata {metadata}
+      , m_payload {data}
+  {
+    m_metadata.add_length(static_cast<uint32_t>(m_payload.size()));
+  }
+
+  DynamicLengthMessage(DynamicLengthMessage&&) noexcept = default;
+  DynamicLengthMessage& operator=(DynamicLengthMessage&&) noexcept = default;
+
+  DynamicLengthMessage share() const { return *this; }
 
-  Metadata get_metadata() const { return m_metadata; }
+  std::span<const uint8_t> get_payload() const { return m_payload; }
+
+  const Metadata& get_metadata() const { return m_metadata; }
 
 private:
+  DynamicLengthMessage(const DynamicLengthMessage&) = default;
+  DynamicLengthMessage& operator=(const DynamicLengthMessage&) = default;
+
   Metadata m_metadata;
-  std::vector<uint8_t> m_payload;
+  std::shared_ptr<const std::vector<uint8_t>> m_owner;
+  std::span<const uint8_t> m_payload;
 };
 
 using BitField = DynamicLengthMessage<MessageMetadata<1, ID_BITFIELD>>;
 using Piece = DynamicLengthMessage<PieceMetadata>;
+using Extended = DynamicLengthMessage<ExtendedMetadata>;
 
 using TorrentMessage = std::variant<Keepalive,
                                     Choke,
@@ -184,8 +326,12 @@ using TorrentMessage = std::variant<Keepalive,
                                     Request,
                                     Piece,
                                     Cancel,
-                                    Port>;
-
-#pragma pack(pop)
+                                    Port,
+                                    SuggestPiece,
+                                    HaveAll,
+                                    HaveNone,
+                                    RejectRequest,
+                                    AllowedFast,
+                                    Extended>;
 
 }  // namespace btr
\ No newline at end of file
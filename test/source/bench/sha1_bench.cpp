@@ -0,0 +1,114 @@
+#include <chrono>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <openssl/sha.h>
+
+#include "torrent/hash/sha1.hpp"
+
+namespace
+{
+using clock_type = std::chrono::steady_clock;
+
+struct BenchCase
+{
+  std::string name;
+  bool supported;
+  std::function<void(std::span<const std::span<const uint8_t>>,
+                     std::span<btr::sha1::Digest>)>
+      hash;
+};
+
+void hash_openssl(std::span<const std::span<const uint8_t>> pieces,
+                  std::span<btr::sha1::Digest> digests)
+{
+  for (size_t i = 0; i < pieces.size(); i++) {
+    SHA1(pieces[i].data(), pieces[i].size(), digests[i].data());
+  }
+}
+
+std::string kernel_name(btr::sha1::Kernel kernel)
+{
+  switch (kernel) {
+    case btr::sha1::Kernel::ShaNi:
+      return "sha-ni";
+    case btr::sha1::Kernel::Avx2MultiBuffer:
+      return "avx2 x8";
+    default:
+      return "scalar";
+  }
+}
+
+std::vector<BenchCase> make_cases()
+{
+  std::vector<BenchCase> cases;
+
+  cases.push_back({"openssl", true, hash_openssl});
+
+  for (auto kernel : {btr::sha1::Kernel::Scalar,
+                      btr::sha1::Kernel::ShaNi,
+                      btr::sha1::Kernel::Avx2MultiBuffer})
+  {
+    cases.push_back({kernel_name(kernel),
+                     btr::sha1::is_supported(kernel),
+                     [kernel](auto pieces, auto digests)
+                     { btr::sha1::hash_many(pieces, digests, kernel); }});
+  }
+
+  return cases;
+}
+}  // namespace
+
+// Hashes a recheck's worth of equally sized pieces with every kernel
+auto main(int argc, char** argv) -> int
+{
+  size_t piece_bytes = (argc > 1 ? std::stoul(argv[1]) : 1024) * 1024;
+  size_t piece_count = argc > 2 ? std::stoul(argv[2]) : 256;
+
+  std::vector<std::vector<uint8_t>> storage(piece_count,
+                                            std::vector<uint8_t>(piece_bytes));
+
+  for (size_t piece = 0; piece < piece_count; piece++) {
+    for (size_t i = 0; i < piece_bytes; i++) {
+      storage[piece][i] = static_cast<uint8_t>(i * 131 + piece);
+    }
+  }
+
+  std::vector<std::span<const uint8_t>> pieces(storage.begin(), storage.end());
+
+  std::vector<btr::sha1::Digest> reference(piece_count);
+  hash_openssl(pieces, reference);
+
+  std::cout << std::format("{} pieces of {} KiB, best kernel is {}\n",
+                           piece_count,
+                           piece_bytes / 1024,
+                           kernel_name(btr::sha1::best_kernel()));
+  std::cout << std::format("{:<10}{:>12}{:>10}\n", "kernel", "MB/s", "valid");
+
+  for (const auto& bench_case : make_cases()) {
+    if (!bench_case.supported) {
+      std::cout << std::format("{:<10}{:>12}\n", bench_case.name, "n/a");
+      continue;
+    }
+
+    std::vector<btr::sha1::Digest> digests(piece_count);
+
+    auto start = clock_type::now();
+    bench_case.hash(pieces, digests);
+    std::chrono::duration<double> elapsed = clock_type::now() - start;
+
+    auto megabytes = static_cast<double>(piece_bytes * piece_count)
+        / (1024.0 * 1024.0);
+
+    std::cout << std::format("{:<10}{:>12.1f}{:>10}\n",
+                             bench_case.name,
+                             megabytes / elapsed.count(),
+                             digests == reference ? "yes" : "NO");
+  }
+
+  return 0;
+}
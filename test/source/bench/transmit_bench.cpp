@@ -0,0 +1,244 @@
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <format>
+#include <iostream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <boost/asio/experimental/awaitable_operators.hpp>
+
+#include "client/transmit/transmit.hpp"
+
+using boost::asio::awaitable;
+using boost::asio::use_awaitable;
+using boost::asio::ip::tcp;
+using namespace boost::asio::experimental::awaitable_operators;
+
+namespace
+{
+std::atomic<uint64_t> g_allocations {0};
+}  // namespace
+
+void* operator new(std::size_t size)
+{
+  ++g_allocations;
+
+  if (auto* ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+
+  throw std::bad_alloc {};
+}
+
+void operator delete(void* ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+namespace
+{
+using clock_type = std::chrono::steady_clock;
+
+constexpr size_t BYTES_PER_CASE = 256 * 1024 * 1024;
+constexpr size_t MAX_BATCH_BYTES = 64 * 1024;
+
+struct BenchCase
+{
+  std::string name;
+  btr::TorrentMessage prototype;
+};
+
+struct BenchResult
+{
+  double messages_per_second;
+  double megabytes_per_second;
+  double latency_ns;
+  double allocations_per_message;
+};
+
+btr::TorrentMessage clone(const btr::TorrentMessage& message)
+{
+  return std::visit(
+      [](const auto& value) -> btr::TorrentMessage
+      {
+        if constexpr (requires { value.share(); }) {
+          return value.share();
+        } else {
+          return value;
+        }
+      },
+      message);
+}
+
+size_t wire_size(const btr::TorrentMessage& message)
+{
+  btr::SendBatch batch;
+  batch.push(clone(message));
+  return batch.bytes();
+}
+
+std::vector<BenchCase> make_cases()
+{
+  btr::Have have {};
+  have.piece_index = 42;
+
+  btr::Cancel cancel {};
+  cancel.piece_index = 42;
+  cancel.length = 16 * 1024;
+
+  btr::Port port {};
+  port.port = 6881;
+
+  std::vector<BenchCase> cases;
+  cases.emplace_back("Keepalive", btr::Keepalive {});
+  cases.emplace_back("Choke", btr::Choke {});
+  cases.emplace_back("Unchoke", btr::Unchoke {});
+  cases.emplace_back("Interested", btr::Interested {});
+  cases.emplace_back("NotInterested", btr::NotInterested {});
+  cases.emplace_back("Have", have);
+  cases.emplace_back("BitField",
+                     btr::BitField {std::vector<uint8_t>(1250, 0xff)});
+  cases.emplace_back("Request", btr::Request {42, 0, 16 * 1024});
+  cases.emplace_back(
+      "Piece", btr::Piece {std::vector<uint8_t>(16 * 1024, 0xab)});
+  cases.emplace_back("Cancel", cancel);
+  cases.emplace_back("Port", port);
+
+  return cases;
+}
+
+awaitable<void> send_all(tcp::socket& socket,
+                         const btr::TorrentMessage& prototype,
+                         size_t count)
+{
+  btr::SendBatch batch;
+
+  for (size_t sent = 0; sent < count;) {
+    batch.clear();
+
+    while (sent < count && batch.bytes() < MAX_BATCH_BYTES) {
+      batch.push(clone(prototype));
+      ++sent;
+    }
+
+    co_await btr::send_messages(socket, batch);
+  }
+}
+
+awaitable<void> receive_all(tcp::socket& socket,
+                            btr::ReceiveBuffer& buffer,
+                            size_t count)
+{
+  for (size_t received = 0; received < count; ++received) {
+    if (!co_await btr::read_message(socket, buffer)) {
+      throw std::runtime_error("bench: failed to parse a message");
+    }
+  }
+}
+
+awaitable<BenchResult> run_case(tcp::socket& client,
+                                tcp::socket& server,
+                                const BenchCase& bench_case,
+                                size_t max_count)
+{
+  btr::ReceiveBuffer buffer {2 * btr::DEFAULT_READ_BYTES};
+
+  auto message_size = wire_size(bench_case.prototype);
+  auto count = std::max<size_t>(
+      1, std::min(max_count, BYTES_PER_CASE / message_size));
+
+  auto allocations_before = g_allocations.load();
+  auto start = clock_type::now();
+
+  co_await (send_all(client, bench_case.prototype, count)
+            && receive_all(server, buffer, count));
+
+  std::chrono::duration<double> elapsed = clock_type::now() - start;
+  auto allocations = g_allocations.load() - allocations_before;
+
+  auto latency_count = std::max<size_t>(1, count / 10);
+  auto latency_start = clock_type::now();
+
+  for (size_t i = 0; i < latency_count; ++i) {
+    co_await btr::send_message(client, bench_case.prototype);
+    co_await btr::read_message(server, buffer);
+  }
+
+  std::chrono::duration<double, std::nano> latency =
+      clock_type::now() - latency_start;
+
+  auto messages = static_cast<double>(count);
+
+  co_return BenchResult {
+      .messages_per_second = messages / elapsed.count(),
+      .megabytes_per_second = messages * static_cast<double>(message_size)
+          / (1024.0 * 1024.0) / elapsed.count(),
+      .latency_ns = latency.count() / static_cast<double>(latency_count),
+      .allocations_per_message = static_cast<double>(allocations) / messages};
+}
+
+awaitable<void> run_bench(size_t max_count)
+{
+  auto io = co_await boost::asio::this_coro::executor;
+
+  tcp::acceptor acceptor {
+      io, tcp::endpoint {boost::asio::ip::address_v4::loopback(), 0}};
+
+  tcp::socket client {io};
+  co_await client.async_connect(acceptor.local_endpoint(), use_awaitable);
+  auto server = co_await acceptor.async_accept(use_awaitable);
+
+  client.set_option(tcp::no_delay {true});
+
+  std::cout << std::format("{:<14}{:>14}{:>12}{:>14}{:>14}\n",
+                           "message",
+                           "msgs/s",
+                           "MB/s",
+                           "latency ns",
+                           "allocs/msg");
+
+  for (const auto& bench_case : make_cases()) {
+    auto result = co_await run_case(client, server, bench_case, max_count);
+
+    std::cout << std::format("{:<14}{:>14.0f}{:>12.1f}{:>14.0f}{:>14.3f}\n",
+                             bench_case.name,
+                             result.messages_per_second,
+                             result.megabytes_per_second,
+                             result.latency_ns,
+                             result.allocations_per_message);
+  }
+}
+}  // namespace
+
+auto main(int argc, char** argv) -> int
+{
+  size_t max_count = argc > 1 ? std::stoul(argv[1]) : 1'000'000;
+
+  boost::asio::io_context io;
+
+  boost::asio::co_spawn(io,
+                        run_bench(max_count),
+                        [](std::exception_ptr error)
+                        {
+                          if (error) {
+                            std::rethrow_exception(error);
+                          }
+                        });
+
+  try {
+    io.run();
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << '\n';
+    return -1;
+  }
+
+  return 0;
+}
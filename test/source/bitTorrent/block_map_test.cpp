@@ -0,0 +1,51 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "client/downloader/block_map.hpp"
+
+TEST_CASE("Block map addresses blocks by offset", "[library]")
+{
+  btr::BlockMap blocks {40 * 1024, 16 * 1024};
+
+  REQUIRE(blocks.block_count() == 3);
+  REQUIRE(blocks.block_length(2) == 8 * 1024);
+
+  REQUIRE(blocks.find_block(16 * 1024, 16 * 1024) == 1);
+  REQUIRE(blocks.find_block(32 * 1024, 8 * 1024) == 2);
+  REQUIRE_FALSE(blocks.find_block(8 * 1024, 16 * 1024));
+  REQUIRE_FALSE(blocks.find_block(32 * 1024, 16 * 1024));
+  REQUIRE_FALSE(blocks.find_block(48 * 1024, 8 * 1024));
+}
+
+TEST_CASE("Duplicate blocks don't complete a piece", "[library]")
+{
+  btr::BlockMap blocks {32 * 1024, 16 * 1024};
+  auto now = btr::BlockMap::clock::now();
+
+  blocks.mark_requested(0, now);
+  blocks.mark_requested(1, now);
+
+  REQUIRE(blocks.mark_received(0) == now);
+  REQUIRE_FALSE(blocks.mark_received(0));
+  REQUIRE_FALSE(blocks.is_complete());
+
+  REQUIRE(blocks.mark_received(1));
+  REQUIRE(blocks.is_complete());
+}
+
+TEST_CASE("Dropped requests are handed out again", "[library]")
+{
+  btr::BlockMap blocks {48 * 1024, 16 * 1024};
+  auto now = btr::BlockMap::clock::now();
+
+  for (size_t block = 0; block < blocks.block_count(); block++) {
+    REQUIRE(blocks.next_missing() == block);
+    blocks.mark_requested(block, now);
+  }
+
+  REQUIRE_FALSE(blocks.next_missing());
+
+  blocks.mark_missing(1);
+
+  REQUIRE(blocks.state(1) == btr::BlockState::Missing);
+  REQUIRE(blocks.next_missing() == 1);
+}
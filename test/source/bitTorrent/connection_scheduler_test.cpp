@@ -0,0 +1,115 @@
+#include <chrono>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "client/reactor/strategy/connection_scheduler.hpp"
+
+using namespace std::chrono_literals;
+
+namespace
+{
+btr::PeerContactInfo contact(const char* address)
+{
+  return {boost::asio::ip::make_address(address), 6881};
+}
+}  // namespace
+
+TEST_CASE("Only a few connects are in flight at once", "[library]")
+{
+  btr::ConnectionScheduler scheduler {{.max_half_open = 2}};
+  auto now = btr::ConnectionScheduler::clock::now();
+
+  scheduler.add(contact("10.0.0.1"), now);
+  scheduler.add(contact("10.0.0.2"), now);
+  scheduler.add(contact("10.0.0.3"), now);
+
+  // Learning a contact twice queues it once
+  scheduler.add(contact("10.0.0.1"), now);
+
+  REQUIRE(scheduler.waiting() == 3);
+
+  auto first = scheduler.next(now);
+  auto second = scheduler.next(now);
+
+  REQUIRE(first == contact("10.0.0.1"));
+  REQUIRE(second == contact("10.0.0.2"));
+  REQUIRE(!scheduler.next(now));
+  REQUIRE(scheduler.half_open() == 2);
+
+  scheduler.on_connected(*first);
+
+  REQUIRE(scheduler.next(now) == contact("10.0.0.3"));
+
+  // Connected contacts aren't queued again
+  scheduler.add(*first, now);
+
+  REQUIRE(scheduler.waiting() == 0);
+}
+
+TEST_CASE("Failing contacts back off exponentially", "[library]")
+{
+  btr::ConnectionScheduler scheduler {{.initial_backoff = 10s,
+                                       .max_backoff = 30s,
+                                       .max_failures = 4}};
+  auto now = btr::ConnectionScheduler::clock::now();
+  auto dead = contact("10.0.0.1");
+
+  scheduler.add(dead, now);
+  scheduler.next(now);
+  scheduler.on_failed(dead, now);
+
+  REQUIRE(scheduler.half_open() == 0);
+  REQUIRE(scheduler.failures(dead) == 1);
+
+  // A tracker announcing it again doesn't cut the backoff short
+  scheduler.add(dead, now + 5s);
+
+  REQUIRE(!scheduler.next(now + 5s));
+  REQUIRE(scheduler.next(now + 10s) == dead);
+
+  scheduler.on_failed(dead, now + 10s);
+
+  REQUIRE(!scheduler.next(now + 29s));
+  REQUIRE(scheduler.next(now + 30s) == dead);
+
+  // Capped
+  scheduler.on_failed(dead, now + 30s);
+
+  REQUIRE(!scheduler.next(now + 59s));
+  REQUIRE(scheduler.next(now + 60s) == dead);
+
+  // Given up on after too many failures in a row
+  scheduler.on_failed(dead, now + 60s);
+  scheduler.add(dead, now + 1h);
+
+  REQUIRE(!scheduler.next(now + 1h));
+}
+
+TEST_CASE("Closed connections are retried, given up ones aren't",
+          "[library]")
+{
+  btr::ConnectionScheduler scheduler {{.initial_backoff = 10s}};
+  auto now = btr::ConnectionScheduler::clock::now();
+  auto flaky = contact("10.0.0.1");
+  auto slow = contact("10.0.0.2");
+
+  scheduler.add(flaky, now);
+  scheduler.next(now);
+  scheduler.on_failed(flaky, now);
+
+  scheduler.next(now + 10s);
+  scheduler.on_connected(flaky);
+
+  // Connecting once forgives the failures before
+  REQUIRE(scheduler.failures(flaky) == 0);
+
+  scheduler.on_closed(flaky, now + 20s);
+
+  REQUIRE(!scheduler.next(now + 25s));
+  REQUIRE(scheduler.next(now + 30s) == flaky);
+
+  scheduler.add(slow, now + 30s);
+  scheduler.give_up(slow);
+
+  REQUIRE(!scheduler.next(now + 30s));
+}
@@ -0,0 +1,82 @@
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "client/reactor/strategy/deadlines.hpp"
+
+using namespace std::chrono_literals;
+
+TEST_CASE("Playback deadlines follow the playback rate", "[library]")
+{
+  auto now = btr::deadline_clock::now();
+
+  REQUIRE(btr::playback_deadline(now, 0, 1000) == now);
+  REQUIRE(btr::playback_deadline(now, 5000, 1000) == now + 5s);
+
+  // Paused playback never reaches the pieces ahead
+  REQUIRE(btr::playback_deadline(now, 5000, 0)
+          == btr::deadline_clock::time_point::max());
+  REQUIRE(btr::playback_deadline(now, 0, 0)
+          == btr::deadline_clock::time_point::max());
+  REQUIRE(btr::playback_deadline(now, 5000, -1)
+          == btr::deadline_clock::time_point::max());
+  REQUIRE(btr::playback_deadline(now, UINT64_MAX, 1e-9)
+          == btr::deadline_clock::time_point::max());
+}
+
+TEST_CASE("Pieces with a deadline go earliest first", "[library]")
+{
+  auto now = btr::deadline_clock::now();
+
+  std::map<uint32_t, btr::deadline_clock::time_point> deadlines {
+      {1, now + 3s}, {2, now + 1s}, {3, now + 2s}, {4, now + 1s}, {5, now}};
+
+  // The earliest is already downloaded
+  std::set<uint32_t> missing {1, 2, 3, 4};
+
+  // Equal deadlines keep the pieces' order
+  REQUIRE(btr::earliest_deadlines(deadlines, missing)
+          == std::vector<uint32_t> {2, 4, 3, 1});
+}
+
+TEST_CASE("Deadlines are at risk when the rate can't make them",
+          "[library]")
+{
+  auto now = btr::deadline_clock::now();
+
+  // 64 KiB at 32 KiB/s takes 2 s
+  REQUIRE(!btr::deadline_at_risk(64 * 1024, 32 * 1024, now + 3s, now));
+  REQUIRE(btr::deadline_at_risk(64 * 1024, 32 * 1024, now + 1s, now));
+
+  // Without a rate it's only late once the deadline passed
+  REQUIRE(!btr::deadline_at_risk(64 * 1024, 0, now + 1s, now));
+  REQUIRE(btr::deadline_at_risk(64 * 1024, 0, now - 1s, now));
+
+  // Nothing left to download is never late
+  REQUIRE(!btr::deadline_at_risk(0, 0, now - 1s, now));
+
+  // Paused playback's pieces are never at risk
+  REQUIRE(!btr::deadline_at_risk(
+      64 * 1024, 1, btr::deadline_clock::time_point::max(), now));
+}
+
+TEST_CASE("Playable bytes end at the first missing piece", "[library]")
+{
+  btr::InternalContext context {};
+  context.piece_size = 1000;
+  context.piece_count = 4;
+
+  // The last piece is 500 bytes short
+  context.file_size = 3500;
+
+  REQUIRE(btr::playable_bytes(context, 1200, {2}) == 800);
+  REQUIRE(btr::playable_bytes(context, 1200, {1}) == 0);
+
+  // Up to the end of the short last piece
+  REQUIRE(btr::playable_bytes(context, 1200, {}) == 2300);
+  REQUIRE(btr::playable_bytes(context, 3000, {}) == 500);
+}
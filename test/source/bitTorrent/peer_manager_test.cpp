@@ -0,0 +1,111 @@
+#include <chrono>
+#include <memory>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "client/reactor/strategy/peer_manager.hpp"
+
+using namespace std::chrono_literals;
+
+TEST_CASE("Connections are capped per torrent and process", "[library]")
+{
+  auto budget = std::make_shared<btr::ConnectionBudget>(3);
+  auto now = btr::PeerManager::clock::now();
+  int peers[4] {};
+
+  {
+    btr::PeerManager first {{.max_connections = 2}, budget};
+    btr::PeerManager second {{.max_connections = 2}, budget};
+
+    first.connected(&peers[0], now);
+    first.connected(&peers[1], now);
+
+    REQUIRE(!first.has_room());
+    REQUIRE(second.has_room());
+
+    second.connected(&peers[2], now);
+
+    // The budget ran out before the second torrent's own limit
+    REQUIRE(!second.has_room());
+
+    first.disconnected(&peers[0]);
+
+    REQUIRE(second.has_room());
+    REQUIRE(budget->connections() == 2);
+  }
+
+  REQUIRE(budget->connections() == 0);
+}
+
+TEST_CASE("Peer rate is a moving average of its deliveries", "[library]")
+{
+  btr::PeerManager manager {{.rate_half_life = 10s},
+                            std::make_shared<btr::ConnectionBudget>(10)};
+  auto now = btr::PeerManager::clock::now();
+  int peer = 0;
+
+  manager.connected(&peer, now);
+
+  // One half life at 1000 B/s gets halfway there
+  manager.record(&peer, 10'000, now + 10s);
+
+  REQUIRE(manager.rate(&peer) > 499);
+  REQUIRE(manager.rate(&peer) < 501);
+
+  uint64_t received = 10'000;
+
+  for (auto at = now + 10s; at < now + 200s; at += 3s) {
+    received += 3000;
+    manager.record(&peer, received, at + 3s);
+  }
+
+  REQUIRE(manager.rate(&peer) > 990);
+  REQUIRE(manager.rate(&peer) < 1010);
+}
+
+TEST_CASE("Slowest peers are turned over for waiting candidates",
+          "[library]")
+{
+  btr::PeerManager manager {{.max_connections = 10,
+                             .min_connection_age = 30s,
+                             .turnover_interval = 60s,
+                             .turnover = 0.2},
+                            std::make_shared<btr::ConnectionBudget>(100)};
+  auto now = btr::PeerManager::clock::now();
+  int peers[10] {};
+
+  for (auto& peer : peers) {
+    manager.connected(&peer, now);
+  }
+
+  // Rates rise with the index
+  for (uint64_t i = 0; i < 10; i++) {
+    manager.record(&peers[i], i * 100'000, now + 40s);
+  }
+
+  // Nobody is replaced without a candidate to take over
+  REQUIRE(manager.select_turnover(0, now + 40s).empty());
+
+  auto slowest = manager.select_turnover(5, now + 40s);
+
+  REQUIRE(slowest.size() == 2);
+  REQUIRE(slowest[0] == &peers[0]);
+  REQUIRE(slowest[1] == &peers[1]);
+
+  // Once per interval
+  REQUIRE(manager.select_turnover(5, now + 50s).empty());
+
+  manager.disconnected(&peers[0]);
+  manager.disconnected(&peers[1]);
+
+  // Below the cutoff there's room for the candidates anyway
+  REQUIRE(manager.select_turnover(5, now + 100s).empty());
+
+  manager.connected(&peers[0], now + 150s);
+
+  // The new peer hasn't delivered yet, but it's too young to be judged
+  auto next = manager.select_turnover(5, now + 170s);
+
+  REQUIRE(next.size() == 1);
+  REQUIRE(next[0] == &peers[2]);
+}
@@ -0,0 +1,122 @@
+#include <set>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "client/reactor/strategy/piece_picker.hpp"
+
+namespace
+{
+aux::BitField all_pieces(uint32_t piece_count)
+{
+  aux::BitField pieces;
+
+  for (uint32_t index = 0; index < piece_count; index++) {
+    pieces.mark(index, true);
+  }
+
+  return pieces;
+}
+}  // namespace
+
+TEST_CASE("Rarest pieces are picked first", "[library]")
+{
+  btr::PiecePicker picker {4};
+  int seeder = 0;
+  int partial = 0;
+
+  picker.add_peer(&seeder);
+  picker.add_peer(&partial);
+
+  picker.set_peer_pieces(&seeder, all_pieces(4));
+  picker.peer_has(&partial, 0);
+  picker.peer_has(&partial, 2);
+  picker.peer_has(&partial, 3);
+
+  // Announcing a piece twice counts once
+  picker.peer_has(&partial, 3);
+
+  REQUIRE(picker.availability(3) == 2);
+  REQUIRE(picker.pick(&seeder, {}) == 1);
+
+  std::vector<uint32_t> downloading {1};
+  auto next = picker.pick(&seeder, downloading);
+
+  REQUIRE(next);
+  REQUIRE(*next != 1);
+
+  // A departing peer takes its pieces' availability along
+  picker.remove_peer(&partial);
+
+  REQUIRE(picker.availability(0) == 1);
+  REQUIRE(picker.availability(3) == 1);
+}
+
+TEST_CASE("Only pieces a peer has and we miss are picked", "[library]")
+{
+  btr::PiecePicker picker {8};
+  int peer = 0;
+
+  picker.add_peer(&peer);
+  picker.peer_has(&peer, 5);
+  picker.peer_has(&peer, 6);
+
+  picker.mark_have(5);
+
+  REQUIRE(picker.pick(&peer, {}) == 6);
+
+  // Pieces fetched by enough peers wait until one drops out
+  picker.add_downloader(6);
+
+  REQUIRE(picker.pick(&peer, {}, true) == std::nullopt);
+  REQUIRE(picker.pick(&peer, {}) == 6);
+
+  picker.add_downloader(6);
+
+  REQUIRE(picker.pick(&peer, {}) == std::nullopt);
+
+  picker.remove_downloader(6);
+
+  REQUIRE(picker.pick(&peer, {}) == 6);
+}
+
+TEST_CASE("Higher priority pieces are picked first", "[library]")
+{
+  btr::PiecePicker picker {1024};
+  int seeder = 0;
+  int other = 0;
+
+  picker.add_peer(&seeder);
+  picker.add_peer(&other);
+  picker.set_peer_pieces(&seeder, all_pieces(1024));
+
+  picker.peer_has(&other, 100);
+  picker.set_priority(700, 2);
+
+  REQUIRE(picker.pick(&seeder, {}) == 700);
+
+  picker.set_priority(700, 0);
+
+  // Back to rarest first, 100 is the only piece two peers have
+  auto next = picker.pick(&seeder, {});
+
+  REQUIRE(next);
+  REQUIRE(*next != 100);
+}
+
+TEST_CASE("Equally rare pieces are picked in random order", "[library]")
+{
+  std::set<uint32_t> first_picks;
+
+  for (int round = 0; round < 8; round++) {
+    btr::PiecePicker picker {1024, {.rarest_first = false}};
+    int seeder = 0;
+
+    picker.add_peer(&seeder);
+    picker.set_peer_pieces(&seeder, all_pieces(1024));
+
+    first_picks.insert(*picker.pick(&seeder, {}));
+  }
+
+  REQUIRE(first_picks.size() > 1);
+}
@@ -0,0 +1,51 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "client/downloader/piece_pool.hpp"
+
+namespace
+{
+constexpr uint32_t PIECE_SIZE = 256 * 1024;
+}  // namespace
+
+TEST_CASE("Released piece buffers are reused", "[library]")
+{
+  btr::PiecePool pool {PIECE_SIZE};
+
+  auto buffer = pool.acquire(PIECE_SIZE);
+  auto* storage = buffer.data();
+
+  REQUIRE(buffer.size() == PIECE_SIZE);
+
+  pool.release(std::move(buffer));
+
+  // The short last piece borrows a full sized buffer
+  auto last_piece = pool.acquire(1000);
+
+  REQUIRE(last_piece.size() == 1000);
+  REQUIRE(last_piece.data() == storage);
+
+  pool.release(std::move(last_piece));
+
+  REQUIRE(pool.acquire(PIECE_SIZE).data() == storage);
+  REQUIRE(pool.allocations() == 1);
+}
+
+TEST_CASE("Piece pool keeps no more than its cap", "[library]")
+{
+  btr::PiecePool pool {PIECE_SIZE, {.max_pooled_bytes = 2 * PIECE_SIZE}};
+
+  auto first = pool.acquire(PIECE_SIZE);
+  auto second = pool.acquire(PIECE_SIZE);
+  auto third = pool.acquire(PIECE_SIZE);
+
+  pool.release(std::move(first));
+  pool.release(std::move(second));
+  pool.release(std::move(third));
+
+  REQUIRE(pool.pooled_bytes() == 2 * PIECE_SIZE);
+
+  pool.release(std::vector<uint8_t>(16));
+
+  REQUIRE(pool.pooled_bytes() == 2 * PIECE_SIZE);
+  REQUIRE(pool.allocations() == 3);
+}
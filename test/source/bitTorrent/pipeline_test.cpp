@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <chrono>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "client/downloader/pipeline.hpp"
+
+namespace
+{
+constexpr uint32_t BLOCK_BYTES = 16 * 1024;
+
+// Delivers a round trip's worth of blocks, as many as the pipeline allows
+// but no more than the link carries
+void deliver_round(btr::RequestPipeline& pipeline,
+                   btr::RequestPipeline::clock::time_point& now,
+                   std::chrono::milliseconds rtt,
+                   size_t link_blocks_per_rtt)
+{
+  auto blocks = std::min(pipeline.depth(), link_blocks_per_rtt);
+
+  for (size_t i = 1; i <= blocks; i++) {
+    auto delivered = now + rtt * i / blocks;
+    pipeline.on_block_delivered(BLOCK_BYTES, delivered - rtt, delivered);
+  }
+
+  now += rtt;
+}
+}  // namespace
+
+TEST_CASE("Pipeline grows until the link is saturated", "[library]")
+{
+  btr::RequestPipeline pipeline {7, 2, 512, BLOCK_BYTES};
+  auto now = btr::RequestPipeline::clock::now();
+
+  // 50 ms at ~10 MB/s carries 30 blocks per round trip
+  for (int round = 0; round < 20; round++) {
+    deliver_round(pipeline, now, std::chrono::milliseconds(50), 30);
+  }
+
+  REQUIRE(pipeline.depth() >= 30);
+  REQUIRE(pipeline.depth() <= 64);
+}
+
+TEST_CASE("Pipeline depth stays within its bounds", "[library]")
+{
+  auto now = btr::RequestPipeline::clock::now();
+
+  btr::RequestPipeline capped {7, 2, 16, BLOCK_BYTES};
+
+  for (int round = 0; round < 20; round++) {
+    deliver_round(capped, now, std::chrono::milliseconds(50), 1000);
+  }
+
+  REQUIRE(capped.depth() == 16);
+
+  btr::RequestPipeline slow {7, 4, 512, BLOCK_BYTES};
+
+  for (int round = 0; round < 20; round++) {
+    deliver_round(slow, now, std::chrono::milliseconds(50), 1);
+  }
+
+  REQUIRE(slow.depth() == 4);
+}
+
+TEST_CASE("Request timeout follows the observed latency", "[library]")
+{
+  btr::RequestPipeline pipeline {7, 2, 512, BLOCK_BYTES};
+  auto now = btr::RequestPipeline::clock::now();
+
+  REQUIRE(pipeline.request_timeout() == std::chrono::seconds(20));
+
+  for (int round = 0; round < 20; round++) {
+    deliver_round(pipeline, now, std::chrono::milliseconds(50), 30);
+  }
+
+  // Steady sub-second latency is floored, not turned into a hair trigger
+  REQUIRE(pipeline.request_timeout() == std::chrono::seconds(2));
+
+  for (int round = 0; round < 20; round++) {
+    deliver_round(pipeline, now, std::chrono::seconds(5), 30);
+  }
+
+  REQUIRE(pipeline.request_timeout() > std::chrono::seconds(5));
+  REQUIRE(pipeline.request_timeout() < std::chrono::seconds(20));
+}
+
+TEST_CASE("Snubbed peers are only probed until they deliver", "[library]")
+{
+  btr::RequestPipeline pipeline {7, 2, 512, BLOCK_BYTES, 1};
+  auto now = btr::RequestPipeline::clock::now();
+
+  for (int round = 0; round < 5; round++) {
+    deliver_round(pipeline, now, std::chrono::milliseconds(50), 30);
+  }
+
+  auto depth = pipeline.depth();
+
+  pipeline.on_timed_out();
+
+  REQUIRE(pipeline.is_snubbed());
+  REQUIRE(pipeline.depth() == 1);
+
+  // A late block for an expired request still shows the peer is alive
+  pipeline.on_block_received();
+
+  REQUIRE(!pipeline.is_snubbed());
+  REQUIRE(pipeline.depth() == depth);
+}
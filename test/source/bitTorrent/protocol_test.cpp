@@ -1,6 +1,8 @@
 #include <catch2/catch_test_macros.hpp>
 #include <string>
+#include <type_traits>
 
+#include "torrent/extension/extension.hpp"
 #include "torrent/messages.hpp"
 
 TEST_CASE("Handshake", "[library]")
@@ -14,3 +16,89 @@ TEST_CASE("Handshake", "[library]")
   // std::string is required to avoid null terminator at the end of the string literal
   REQUIRE(handshake.pname.m_data == std::string("BitTorrent protocol"));
 }
+
+
+TEST_CASE("Dynamic payloads are moved and shared, never copied", "[library]")
+{
+  STATIC_REQUIRE_FALSE(std::is_copy_constructible_v<btr::TorrentMessage>);
+  STATIC_REQUIRE(std::is_nothrow_move_constructible_v<btr::TorrentMessage>);
+
+  btr::BitField bitfield {std::vector<uint8_t> {0xff, 0x0f}};
+  auto shared = bitfield.share();
+
+  REQUIRE(shared.get_payload().data() == bitfield.get_payload().data());
+  REQUIRE(shared.get_metadata().length == bitfield.get_metadata().length);
+
+  btr::TorrentMessage message {std::move(bitfield)};
+
+  REQUIRE(std::get<btr::BitField>(message).get_payload().data()
+          == shared.get_payload().data());
+}
+
+TEST_CASE("Handshake advertises the Fast Extension", "[library]")
+{
+  btr::InternalContext context {};
+  context.info_hash = std::vector<uint8_t>(20);
+
+  REQUIRE(btr::Handshake {context}.supports_fast_extension());
+  REQUIRE_FALSE(btr::Handshake {}.supports_fast_extension());
+}
+
+TEST_CASE("Peer exchange round trips compact contacts", "[library]")
+{
+  auto handshake = btr::make_extended_handshake();
+  auto parsed_handshake
+      = btr::parse_extended_handshake(handshake.get_payload());
+
+  REQUIRE(parsed_handshake.has_value());
+  REQUIRE(parsed_handshake->ut_pex_id == btr::LOCAL_UT_PEX_ID);
+
+  std::vector<btr::PeerContactInfo> contacts {
+      {boost::asio::ip::make_address("10.0.0.1"), 6881},
+      {boost::asio::ip::make_address("::1"), 51413}};
+
+  auto message =
+      btr::make_peer_exchange(btr::LOCAL_UT_PEX_ID, {contacts, contacts});
+
+  REQUIRE(message.get_metadata().extended_id == btr::LOCAL_UT_PEX_ID);
+  REQUIRE(btr::parse_peer_exchange(message.get_payload()) == contacts);
+}
+
+TEST_CASE("Peer exchange only sends changes to the swarm", "[library]")
+{
+  std::vector<btr::PeerContactInfo> swarm;
+
+  for (uint16_t port = 1; port <= 60; port++) {
+    swarm.emplace_back(boost::asio::ip::make_address("10.0.0.1"), port);
+  }
+
+  btr::PeerExchangeState state;
+
+  // Too many for one message, the rest follows with the next
+  auto first = state.next(swarm);
+
+  REQUIRE(first.added.size() == btr::MAX_PEX_PEERS);
+  REQUIRE(first.dropped.empty());
+
+  // Nothing counts as sent until it was
+  REQUIRE(state.next(swarm).added == first.added);
+
+  state.advance(first);
+
+  auto second = state.next(swarm);
+
+  REQUIRE(second.added.size() == 10);
+  REQUIRE(second.added.front() == swarm[50]);
+
+  state.advance(second);
+
+  REQUIRE(state.next(swarm).empty());
+
+  auto departed = swarm.front();
+  swarm.erase(swarm.begin());
+
+  auto third = state.next(swarm);
+
+  REQUIRE(third.added.empty());
+  REQUIRE(third.dropped == std::vector {departed});
+}
@@ -0,0 +1,88 @@
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include "client/reactor/strategy/strategy.hpp"
+
+namespace
+{
+constexpr uint32_t PIECE_SIZE = 16 * 1024;
+
+void run(std::function<boost::asio::awaitable<void>()> test)
+{
+  boost::asio::io_context io;
+
+  boost::asio::co_spawn(io,
+                        std::move(test),
+                        [](std::exception_ptr error)
+                        {
+                          if (error) {
+                            std::rethrow_exception(error);
+                          }
+                        });
+
+  io.run();
+}
+
+std::vector<uint8_t> filled(uint8_t value)
+{
+  return std::vector<uint8_t>(PIECE_SIZE, value);
+}
+
+std::shared_ptr<btr::InternalContext> make_context()
+{
+  auto context = std::make_shared<btr::InternalContext>();
+
+  context->file_size = 2 * PIECE_SIZE;
+  context->piece_size = PIECE_SIZE;
+  context->piece_count = 2;
+
+  for (uint8_t value : {1, 2}) {
+    btr::PieceHasher hasher;
+    hasher.update(filled(value));
+    context->piece_hashes.push_back(hasher.finish());
+  }
+
+  return context;
+}
+}  // namespace
+
+TEST_CASE("Pieces failing their recheck are stored again", "[library]")
+{
+  auto vault = std::filesystem::temp_directory_path() / "torrenter_recheck";
+  std::filesystem::remove_all(vault);
+
+  auto context = make_context();
+  auto storage = std::make_shared<FileDirectoryStorage>(vault);
+  auto info_hash = context->info_hash_as_string();
+
+  run(
+      [&]() -> boost::asio::awaitable<void>
+      {
+        co_await storage->push_piece(info_hash, 0, filled(1));
+        co_await storage->push_piece(info_hash, 1, filled(9));
+
+        btr::RandomPieceStrategy strategy {context, storage};
+        co_await strategy.recheck();
+
+        // The corrupt copy is gone, only the good one is kept
+        REQUIRE(!co_await strategy.is_done());
+        REQUIRE(storage->exists(info_hash, 0));
+        REQUIRE(!storage->exists(info_hash, 1));
+
+        // Downloaded again, the piece is stored like any completed one
+        co_await storage->push_piece(info_hash, 1, filled(2));
+
+        btr::RandomPieceStrategy restarted {context, storage};
+        co_await restarted.recheck();
+
+        REQUIRE(co_await restarted.is_done());
+      });
+
+  std::filesystem::remove_all(vault);
+}
@@ -0,0 +1,90 @@
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "torrent/hash/sha1.hpp"
+
+namespace
+{
+std::vector<uint8_t> from_hex(std::string_view hex)
+{
+  std::vector<uint8_t> bytes;
+
+  for (size_t i = 0; i < hex.size(); i += 2) {
+    bytes.push_back(static_cast<uint8_t>(
+        std::stoi(std::string(hex.substr(i, 2)), nullptr, 16)));
+  }
+
+  return bytes;
+}
+
+std::vector<uint8_t> as_bytes(std::string_view text)
+{
+  return {text.begin(), text.end()};
+}
+
+constexpr btr::sha1::Kernel KERNELS[] = {btr::sha1::Kernel::Scalar,
+                                         btr::sha1::Kernel::ShaNi,
+                                         btr::sha1::Kernel::Avx2MultiBuffer};
+}  // namespace
+
+TEST_CASE("SHA-1 matches the FIPS 180 test vectors", "[library]")
+{
+  auto abc = as_bytes("abc");
+  auto two_blocks =
+      as_bytes("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq");
+
+  REQUIRE(std::ranges::equal(
+      btr::sha1::hash(abc),
+      from_hex("a9993e364706816aba3e25717850c26c9cd0d89d")));
+  REQUIRE(std::ranges::equal(
+      btr::sha1::hash(two_blocks),
+      from_hex("84983e441c3bd26ebaae4aa1f95129e5e54670f1")));
+  REQUIRE(std::ranges::equal(
+      btr::sha1::hash({}),
+      from_hex("da39a3ee5e6b4b0d3255bfef95601890afd80709")));
+}
+
+TEST_CASE("Every supported SHA-1 kernel agrees", "[library]")
+{
+  std::vector<std::vector<uint8_t>> storage;
+
+  // Lengths around the padding boundaries, several of each so lanes fill up
+  for (size_t length :
+       std::initializer_list<size_t> {
+           0, 1, 55, 56, 63, 64, 65, 119, 120, 1000, 16384})
+  {
+    for (size_t copy = 0; copy < 10; copy++) {
+      std::vector<uint8_t> message(length);
+
+      for (size_t i = 0; i < length; i++) {
+        message[i] = static_cast<uint8_t>(i * 31 + copy * 7 + length);
+      }
+
+      storage.push_back(std::move(message));
+    }
+  }
+
+  std::vector<std::span<const uint8_t>> messages(storage.begin(),
+                                                 storage.end());
+
+  std::vector<btr::sha1::Digest> expected(messages.size());
+  btr::sha1::hash_many(messages, expected, btr::sha1::Kernel::Scalar);
+
+  for (auto kernel : KERNELS) {
+    if (!btr::sha1::is_supported(kernel)) {
+      continue;
+    }
+
+    std::vector<btr::sha1::Digest> digests(messages.size());
+    btr::sha1::hash_many(messages, digests, kernel);
+
+    REQUIRE(digests == expected);
+  }
+}
@@ -0,0 +1,272 @@
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "client/downloader/shared_piece.hpp"
+
+namespace
+{
+constexpr uint32_t BLOCK_SIZE = 16 * 1024;
+constexpr uint32_t PIECE_SIZE = 4 * BLOCK_SIZE;
+
+std::shared_ptr<btr::InternalContext> make_context()
+{
+  auto context = std::make_shared<btr::InternalContext>();
+
+  // The last piece is a single block
+  context->file_size = 2 * PIECE_SIZE + BLOCK_SIZE;
+  context->piece_size = PIECE_SIZE;
+  context->piece_count = 3;
+  context->piece_hashes.resize(context->piece_count);
+
+  return context;
+}
+
+btr::PartialPieces make_partial_pieces(
+    std::shared_ptr<btr::InternalContext> context)
+{
+  // Pieces this small are buffered whole, storage is never touched
+  return btr::PartialPieces {std::move(context),
+                             std::make_shared<btr::PiecePool>(PIECE_SIZE),
+                             nullptr};
+}
+
+// Stands in for a peer's downloader, dropping the requests it's told to cancel
+struct RecordingRequester : btr::IBlockRequester
+{
+  std::shared_ptr<btr::SharedPiece> shared;
+  std::vector<size_t> cancelled;
+
+  explicit RecordingRequester(std::shared_ptr<btr::SharedPiece> piece)
+      : shared {std::move(piece)}
+  {
+  }
+
+  void cancel_block(uint32_t, size_t block) override
+  {
+    cancelled.push_back(block);
+    shared->drop_request(block, *this);
+  }
+};
+}  // namespace
+
+TEST_CASE("Peers share one download of a piece", "[library]")
+{
+  auto partial = make_partial_pieces(make_context());
+  auto now = btr::BlockMap::clock::now();
+
+  auto first = partial.join(0);
+
+  REQUIRE(partial.join(0) == first);
+  REQUIRE(partial.find(0) == first);
+  REQUIRE(partial.find(1) == nullptr);
+  REQUIRE(!first->streaming);
+
+  RecordingRequester one {first};
+  RecordingRequester other {first};
+
+  // Requested from two peers in endgame, it's missing once both gave up
+  first->add_request(0, now, one);
+  first->add_request(0, now, other);
+  first->drop_request(0, one);
+
+  REQUIRE(first->blocks.state(0) == btr::BlockState::Requested);
+
+  // Dropping a request twice doesn't count for the other peer
+  first->drop_request(0, one);
+
+  REQUIRE(first->blocks.state(0) == btr::BlockState::Requested);
+
+  first->drop_request(0, other);
+
+  REQUIRE(first->blocks.state(0) == btr::BlockState::Missing);
+}
+
+TEST_CASE("Expired requests free their blocks for other peers", "[library]")
+{
+  auto partial = make_partial_pieces(make_context());
+  auto now = btr::BlockMap::clock::now();
+
+  auto shared = partial.join(0);
+  RecordingRequester stalled {shared};
+
+  for (size_t block = 0; block < 4; block++) {
+    shared->add_request(block, now, stalled);
+  }
+
+  shared->blocks.mark_received(0);
+
+  REQUIRE(!shared->blocks.next_missing());
+  REQUIRE(partial.unclaimed().empty());
+
+  // The stalled peer's request timed out, another peer may take the block
+  shared->drop_request(2, stalled);
+
+  REQUIRE(shared->blocks.state(2) == btr::BlockState::Missing);
+  REQUIRE(shared->blocks.next_missing() == 2);
+  REQUIRE(partial.unclaimed() == std::vector<uint32_t> {0});
+
+  // Received blocks stay received whatever happens to their requests
+  shared->drop_request(0, stalled);
+
+  REQUIRE(shared->blocks.state(0) == btr::BlockState::Received);
+}
+
+TEST_CASE("A stalled read in place frees its block once it expires",
+          "[library]")
+{
+  auto partial = make_partial_pieces(make_context());
+  auto now = btr::BlockMap::clock::now();
+
+  auto shared = partial.join(0);
+  RecordingRequester stalled {shared};
+  RecordingRequester other {shared};
+
+  shared->add_request(0, now, stalled);
+  shared->add_request(0, now, other);
+
+  // The stalled peer started reading the block into the piece
+  REQUIRE(shared->start_transit(0, stalled));
+  REQUIRE(!shared->start_transit(0, other));
+
+  // Only its own copy may complete the block meanwhile
+  REQUIRE(!shared->receive(0, other));
+
+  // Its request expired, the read is given up along with it
+  shared->end_transit(0, stalled);
+  shared->drop_request(0, stalled);
+
+  REQUIRE(shared->in_transit.empty());
+  REQUIRE(shared->blocks.state(0) == btr::BlockState::Requested);
+
+  REQUIRE(shared->receive(0, other));
+  REQUIRE(!shared->start_transit(0, stalled));
+  REQUIRE(stalled.cancelled.empty());
+}
+
+TEST_CASE("Only a racing peer requests blocks asked for elsewhere",
+          "[library]")
+{
+  auto partial = make_partial_pieces(make_context());
+  auto now = btr::BlockMap::clock::now();
+
+  auto shared = partial.join(0);
+  RecordingRequester slow_peer {shared};
+  RecordingRequester fast_peer {shared};
+  btr::block_requests slow;
+  btr::block_requests fast;
+
+  // The slow peer holds every request of the piece
+  while (auto block = shared->next_block(slow, false)) {
+    shared->add_request(*block, now, slow_peer);
+    slow.emplace(*block, now);
+  }
+
+  REQUIRE(slow.size() == 4);
+  REQUIRE(!shared->next_block(fast, false));
+
+  // Racing for a deadline, the fast peer re-requests them
+  auto block = shared->next_block(fast, true);
+
+  REQUIRE(block == 0);
+
+  shared->add_request(*block, now, fast_peer);
+  fast.emplace(*block, now);
+
+  // But never a block it already asked for itself
+  REQUIRE(shared->next_block(fast, true) == 1);
+
+  shared->blocks.mark_received(1);
+
+  REQUIRE(shared->next_block(fast, true) == 2);
+  REQUIRE(shared->missing_bytes() == 3 * BLOCK_SIZE);
+}
+
+TEST_CASE("Delivered blocks are cancelled with the other peers", "[library]")
+{
+  auto partial = make_partial_pieces(make_context());
+  auto now = btr::BlockMap::clock::now();
+
+  auto shared = partial.join(0);
+  RecordingRequester first {shared};
+  RecordingRequester second {shared};
+
+  // Both raced for the block, the first to deliver it wins
+  shared->add_request(0, now, first);
+  shared->add_request(0, now, second);
+  shared->add_request(1, now, second);
+
+  REQUIRE(shared->receive(0, first));
+  REQUIRE(shared->blocks.state(0) == btr::BlockState::Received);
+
+  REQUIRE(first.cancelled.empty());
+  REQUIRE(second.cancelled == std::vector<size_t> {0});
+  REQUIRE(shared->requesters[0]
+          == std::vector<btr::IBlockRequester*> {&first});
+
+  // Its copy arriving anyway neither counts nor cancels anything
+  REQUIRE(!shared->receive(0, second));
+  REQUIRE(second.cancelled == std::vector<size_t> {0});
+
+  // Blocks only requested from the receiver cancel nothing
+  REQUIRE(shared->receive(1, second));
+  REQUIRE(first.cancelled.empty());
+}
+
+TEST_CASE("Pieces closest to done are joined first", "[library]")
+{
+  auto partial = make_partial_pieces(make_context());
+  auto now = btr::BlockMap::clock::now();
+
+  auto barely_started = partial.join(0);
+  auto nearly_done = partial.join(1);
+  auto claimed = partial.join(2);
+  RecordingRequester peer {barely_started};
+
+  barely_started->add_request(0, now, peer);
+
+  for (size_t block = 0; block < 3; block++) {
+    nearly_done->add_request(block, now, peer);
+    nearly_done->blocks.mark_received(block);
+  }
+
+  // Every block of it is requested already
+  claimed->add_request(0, now, peer);
+
+  REQUIRE(partial.unclaimed() == std::vector<uint32_t> {1, 0});
+}
+
+TEST_CASE("Only completely hashed pieces are retrieved", "[library]")
+{
+  auto context = make_context();
+  auto partial = make_partial_pieces(context);
+
+  auto shared = partial.join(2);
+  std::ranges::fill(shared->piece.data, uint8_t {7});
+
+  btr::PieceHasher expected;
+  expected.update(shared->piece.data);
+  context->piece_hashes[2] = expected.finish();
+
+  REQUIRE(!partial.retrieve(2));
+
+  shared->blocks.mark_received(0);
+  shared->hasher.update(shared->piece.data);
+  shared->piece.status = btr::PieceStatus::Complete;
+
+  auto piece = partial.retrieve(2);
+
+  REQUIRE(piece);
+  REQUIRE(piece->status == btr::PieceStatus::Complete);
+  REQUIRE(piece->data.size() == BLOCK_SIZE);
+  REQUIRE(partial.find(2) == nullptr);
+
+  // A mismatching digest starts the piece over
+  auto corrupt = partial.join(0);
+  corrupt->piece.status = btr::PieceStatus::Complete;
+
+  REQUIRE(partial.retrieve(0)->status == btr::PieceStatus::Corrupt);
+  REQUIRE(partial.join(0) != corrupt);
+}
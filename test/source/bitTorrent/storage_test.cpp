@@ -0,0 +1,271 @@
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include "client/storage/storage.hpp"
+
+namespace
+{
+constexpr size_t BLOCK_SIZE = 16 * 1024;
+constexpr std::string_view INFO_HASH = "0123456789abcdef";
+
+// A vault of its own for every test, removed afterwards
+struct TemporaryVault
+{
+  std::filesystem::path path;
+
+  explicit TemporaryVault(const std::string& name)
+      : path {std::filesystem::temp_directory_path() / ("torrenter_" + name)}
+  {
+    std::filesystem::remove_all(path);
+  }
+
+  ~TemporaryVault() { std::filesystem::remove_all(path); }
+
+  std::filesystem::path part(size_t index, uint64_t part) const
+  {
+    return path / INFO_HASH
+        / (std::to_string(index) + "." + std::to_string(part) + ".part");
+  }
+};
+
+void run(std::function<boost::asio::awaitable<void>()> test)
+{
+  boost::asio::io_context io;
+
+  boost::asio::co_spawn(io,
+                        std::move(test),
+                        [](std::exception_ptr error)
+                        {
+                          if (error) {
+                            std::rethrow_exception(error);
+                          }
+                        });
+
+  io.run();
+}
+
+std::vector<uint8_t> filled(size_t size, uint8_t value)
+{
+  return std::vector<uint8_t>(size, value);
+}
+}  // namespace
+
+TEST_CASE("Streamed blocks become the piece once committed", "[library]")
+{
+  TemporaryVault vault {"commit"};
+  FileDirectoryStorage storage {vault.path};
+
+  run(
+      [&]() -> boost::asio::awaitable<void>
+      {
+        auto first = filled(BLOCK_SIZE, 1);
+        auto second = filled(BLOCK_SIZE, 2);
+
+        // Blocks arrive in any order
+        co_await storage.push_block(INFO_HASH, 3, 7, BLOCK_SIZE, second);
+        co_await storage.push_block(INFO_HASH, 3, 7, 0, first);
+
+        std::vector<uint8_t> block(BLOCK_SIZE);
+
+        auto pulled =
+            co_await storage.pull_block(INFO_HASH, 3, 7, BLOCK_SIZE, block);
+
+        REQUIRE(pulled);
+        REQUIRE(block == second);
+
+        // The part only becomes the piece once committed
+        REQUIRE(!storage.exists(INFO_HASH, 3));
+
+        storage.commit_piece(INFO_HASH, 3, 7);
+
+        REQUIRE(storage.exists(INFO_HASH, 3));
+        REQUIRE(!std::filesystem::exists(vault.part(3, 7)));
+
+        std::vector<uint8_t> piece(2 * BLOCK_SIZE);
+
+        pulled = co_await storage.pull_piece(
+            INFO_HASH, 3, 0, piece.size(), piece);
+
+        REQUIRE(pulled);
+        REQUIRE(std::vector(piece.begin(), piece.begin() + BLOCK_SIZE)
+                == first);
+        REQUIRE(std::vector(piece.begin() + BLOCK_SIZE, piece.end())
+                == second);
+      });
+}
+
+TEST_CASE("The first committed copy of a piece is kept", "[library]")
+{
+  TemporaryVault vault {"second_copy"};
+  FileDirectoryStorage storage {vault.path};
+
+  run(
+      [&]() -> boost::asio::awaitable<void>
+      {
+        co_await storage.push_block(INFO_HASH, 0, 1, 0, filled(BLOCK_SIZE, 1));
+        co_await storage.push_block(INFO_HASH, 0, 2, 0, filled(BLOCK_SIZE, 2));
+
+        storage.commit_piece(INFO_HASH, 0, 1);
+        storage.commit_piece(INFO_HASH, 0, 2);
+
+        REQUIRE(!std::filesystem::exists(vault.part(0, 2)));
+
+        std::vector<uint8_t> piece(BLOCK_SIZE);
+
+        auto pulled = co_await storage.pull_piece(
+            INFO_HASH, 0, 0, piece.size(), piece);
+
+        REQUIRE(pulled);
+        REQUIRE(piece == filled(BLOCK_SIZE, 1));
+      });
+}
+
+TEST_CASE("Discarded parts leave nothing behind", "[library]")
+{
+  TemporaryVault vault {"discard"};
+  FileDirectoryStorage storage {vault.path};
+
+  run(
+      [&]() -> boost::asio::awaitable<void>
+      {
+        co_await storage.push_block(INFO_HASH, 5, 4, 0, filled(BLOCK_SIZE, 9));
+
+        // The piece turned out corrupt
+        storage.discard_piece(INFO_HASH, 5, 4);
+
+        REQUIRE(!std::filesystem::exists(vault.part(5, 4)));
+        REQUIRE(!storage.exists(INFO_HASH, 5));
+
+        std::vector<uint8_t> block(BLOCK_SIZE);
+
+        auto pulled = co_await storage.pull_block(INFO_HASH, 5, 4, 0, block);
+
+        REQUIRE(!pulled);
+
+        // Discarding a part that is already gone is harmless
+        storage.discard_piece(INFO_HASH, 5, 4);
+      });
+}
+
+TEST_CASE("Removed pieces are replaced by the next commit", "[library]")
+{
+  TemporaryVault vault {"remove"};
+  FileDirectoryStorage storage {vault.path};
+
+  run(
+      [&]() -> boost::asio::awaitable<void>
+      {
+        co_await storage.push_piece(INFO_HASH, 2, filled(BLOCK_SIZE, 9));
+
+        // The stored copy failed its recheck
+        storage.remove_piece(INFO_HASH, 2);
+
+        REQUIRE(!storage.exists(INFO_HASH, 2));
+
+        // Removing it again is harmless
+        storage.remove_piece(INFO_HASH, 2);
+
+        co_await storage.push_block(INFO_HASH, 2, 0, 0, filled(BLOCK_SIZE, 3));
+        storage.commit_piece(INFO_HASH, 2, 0);
+
+        std::vector<uint8_t> piece(BLOCK_SIZE);
+
+        auto pulled = co_await storage.pull_piece(
+            INFO_HASH, 2, 0, piece.size(), piece);
+
+        REQUIRE(pulled);
+        REQUIRE(piece == filled(BLOCK_SIZE, 3));
+      });
+}
+
+TEST_CASE("Parts are committed once their blocks in flight are written",
+          "[library]")
+{
+  TemporaryVault vault {"in_flight"};
+  FileDirectoryStorage storage {vault.path};
+
+  run(
+      [&]() -> boost::asio::awaitable<void>
+      {
+        auto io = co_await boost::asio::this_coro::executor;
+        auto late = filled(BLOCK_SIZE, 4);
+        bool written = false;
+
+        co_await storage.push_block(INFO_HASH, 6, 1, 0, filled(BLOCK_SIZE, 3));
+
+        // Another peer's duplicate is still being written
+        boost::asio::co_spawn(
+            io,
+            [&]() -> boost::asio::awaitable<void>
+            {
+              co_await storage.push_block(INFO_HASH, 6, 1, BLOCK_SIZE, late);
+              written = true;
+            },
+            boost::asio::detached);
+
+        co_await boost::asio::post(io, boost::asio::use_awaitable);
+
+        REQUIRE(!written);
+
+        storage.commit_piece(INFO_HASH, 6, 1);
+
+        REQUIRE(!storage.exists(INFO_HASH, 6));
+
+        // Nothing is written to a part on its way out
+        co_await storage.push_block(INFO_HASH, 6, 1, 0, filled(BLOCK_SIZE, 9));
+
+        while (!written) {
+          co_await boost::asio::post(io, boost::asio::use_awaitable);
+        }
+
+        REQUIRE(storage.exists(INFO_HASH, 6));
+        REQUIRE(!std::filesystem::exists(vault.part(6, 1)));
+
+        std::vector<uint8_t> piece(2 * BLOCK_SIZE);
+
+        auto pulled = co_await storage.pull_piece(
+            INFO_HASH, 6, 0, piece.size(), piece);
+
+        REQUIRE(pulled);
+        REQUIRE(std::vector(piece.begin(), piece.begin() + BLOCK_SIZE)
+                == filled(BLOCK_SIZE, 3));
+        REQUIRE(std::vector(piece.begin() + BLOCK_SIZE, piece.end()) == late);
+      });
+}
+
+TEST_CASE("Parts left behind by a previous run are discarded", "[library]")
+{
+  TemporaryVault vault {"leftover"};
+
+  run(
+      [&]() -> boost::asio::awaitable<void>
+      {
+        {
+          FileDirectoryStorage previous {vault.path};
+
+          co_await previous.push_block(
+              INFO_HASH, 0, 0, BLOCK_SIZE, filled(10, 1));
+          co_await previous.push_piece(INFO_HASH, 1, filled(10, 2));
+        }
+
+        FileDirectoryStorage storage {vault.path};
+        storage.discard_parts(INFO_HASH);
+
+        REQUIRE(!std::filesystem::exists(vault.part(0, 0)));
+        REQUIRE(storage.exists(INFO_HASH, 1));
+
+        // Numbered from the start again, the part begins empty
+        co_await storage.push_block(INFO_HASH, 0, 0, 0, filled(10, 3));
+
+        REQUIRE(std::filesystem::file_size(vault.part(0, 0)) == 10);
+
+        // Nothing to discard for torrents never downloaded
+        storage.discard_parts("unknown");
+      });
+}
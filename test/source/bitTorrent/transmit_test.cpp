@@ -0,0 +1,116 @@
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "client/transmit/transmit.hpp"
+
+namespace
+{
+template<typename T>
+void append(btr::ReceiveBuffer& buffer,
+            const T& message,
+            size_t size = sizeof(T))
+{
+  auto space = buffer.prepare(size);
+  std::memcpy(space.data(), &message, size);
+  buffer.commit(size);
+}
+}  // namespace
+
+TEST_CASE("Decodes every complete message in the buffer", "[library]")
+{
+  btr::ReceiveBuffer buffer {64};
+
+  btr::Have first {};
+  first.piece_index = 3;
+  btr::Have second {};
+  second.piece_index = 9;
+  btr::Request request {1, 0, 16 * 1024};
+
+  append(buffer, first);
+  append(buffer, btr::Keepalive {});
+  append(buffer, second);
+  append(buffer, request, 6);
+
+  auto message = btr::decode_message(buffer);
+  REQUIRE(message.has_value());
+  REQUIRE(std::get<btr::Have>(**message).piece_index == 3);
+
+  message = btr::decode_message(buffer);
+  REQUIRE(message.has_value());
+  REQUIRE(std::holds_alternative<btr::Keepalive>(**message));
+
+  message = btr::decode_message(buffer);
+  REQUIRE(message.has_value());
+  REQUIRE(std::get<btr::Have>(**message).piece_index == 9);
+
+  REQUIRE_FALSE(btr::decode_message(buffer).has_value());
+
+  auto space = buffer.prepare(sizeof(request) - 6);
+  std::memcpy(
+      space.data(), reinterpret_cast<uint8_t*>(&request) + 6, space.size());
+  buffer.commit(space.size());
+
+  message = btr::decode_message(buffer);
+  REQUIRE(message.has_value());
+  REQUIRE(std::get<btr::Request>(**message).length == 16 * 1024);
+  REQUIRE(buffer.size() == 0);
+}
+
+TEST_CASE("Piece payload is parsed in place", "[library]")
+{
+  btr::ReceiveBuffer buffer {64};
+
+  btr::PieceMetadata metadata {};
+  metadata.add_length(4);
+  metadata.piece_index = 2;
+  metadata.offset_within_piece = 16;
+
+  append(buffer, metadata);
+  append(buffer, uint32_t {0xdeadbeef});
+
+  auto message = btr::decode_message(buffer);
+  REQUIRE(message.has_value());
+
+  const auto& piece = std::get<btr::Piece>(**message);
+  REQUIRE(piece.get_metadata().offset_within_piece == 16);
+  REQUIRE(piece.get_payload().size() == 4);
+  REQUIRE(*reinterpret_cast<const uint32_t*>(piece.get_payload().data())
+          == 0xdeadbeef);
+}
+
+TEST_CASE("Messages longer than any legal one are rejected", "[library]")
+{
+  btr::ReceiveBuffer buffer {64};
+
+  // A hostile length prefix is rejected before its payload arrives
+  append(buffer, uint32_big {UINT32_MAX});
+  append(buffer, uint8_t {btr::ID_PIECE});
+
+  auto message = btr::decode_message(buffer);
+  REQUIRE(message.has_value());
+  REQUIRE(message->error() == btr::ParseError::TooLong);
+
+  // A large torrent's bitfield may still exceed the default limit
+  btr::ReceiveBuffer bitfield_buffer {64};
+  auto bits = std::vector<uint8_t>(btr::MAX_MESSAGE_BYTES, 0xff);
+
+  append(bitfield_buffer,
+         uint32_big {static_cast<uint32_t>(bits.size() + 1)});
+  append(bitfield_buffer, uint8_t {btr::ID_BITFIELD});
+
+  auto space = bitfield_buffer.prepare(bits.size());
+  std::memcpy(space.data(), bits.data(), bits.size());
+  bitfield_buffer.commit(bits.size());
+
+  REQUIRE(btr::decode_message(bitfield_buffer, btr::MAX_MESSAGE_BYTES)
+              ->error()
+          == btr::ParseError::TooLong);
+
+  message = btr::decode_message(bitfield_buffer, bits.size() + 1);
+  REQUIRE(message.has_value());
+  REQUIRE(std::get<btr::BitField>(**message).get_payload().size()
+          == bits.size());
+}